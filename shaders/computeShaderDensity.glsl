@@ -0,0 +1,35 @@
+#version 460 core
+layout (local_size_x = 16, local_size_y = 16) in;
+uniform sampler2D density; // Summed colors, the opacity summing to the density
+uniform int pass;          // 0: largest density, 1: histogram, 2: cumulative histogram
+
+layout (std430, binding = 0) buffer Histogram {
+    uint maxDensity; // Bits of the float, ordered as the positive floats
+    uint total;      // Pixels drawn
+    uint bins[256];  // Pixels per bin of log(1 + d) / log(1 + max)
+    float cdf[256];
+};
+
+void main(){
+    if (pass == 2) {
+        if (gl_GlobalInvocationID.x != 0 || gl_GlobalInvocationID.y != 0) return;
+        uint sum = 0;
+        for (int i = 0; i < 256; i++){
+            sum += bins[i];
+            cdf[i] = float(sum) / float(max(total, 1u));
+        }
+        return;
+    }
+
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, textureSize(density, 0)))) return;
+    float d = texelFetch(density, pixel, 0).a;
+    if (d <= 0.0) return;
+
+    if (pass == 0) atomicMax(maxDensity, floatBitsToUint(d));
+    else {
+        float t = log(1.0 + d) / log(1.0 + uintBitsToFloat(maxDensity));
+        atomicAdd(bins[min(int(256.0 * t), 255)], 1u);
+        atomicAdd(total, 1u);
+    }
+}
@@ -1,6 +1,13 @@
 #version 460 core
+noperspective in float offset;
+flat in float halfWidth;
+flat in float alpha;
+uniform bool density; // Summed additively : the opacity is output premultiplied
 out vec4 FragColor;
 
 void main() {
-    FragColor = vec4(1.0f, 1.0f, 1.0f, 0.1f);
-} 
+    // Coverage of the pixel by the edge, from its distance to the center
+    float coverage = clamp(halfWidth + 0.5 - abs(offset), 0.0, 1.0);
+    if (density) FragColor = vec4(vec3(alpha * coverage), alpha * coverage);
+    else FragColor = vec4(1.0f, 1.0f, 1.0f, alpha * coverage);
+}
@@ -0,0 +1,25 @@
+#version 460 core
+in vec2 uv;
+uniform sampler2D density; // Summed colors, the opacity summing to the density
+uniform int tone;          // 1: log, 2: histogram equalization
+uniform vec3 background;
+out vec4 FragColor;
+
+layout (std430, binding = 0) buffer Histogram {
+    uint maxDensity;
+    uint total;
+    uint bins[256];
+    float cdf[256];
+};
+
+void main(){
+    vec4 d = texture(density, uv);
+    if (d.a <= 0.0) {
+        FragColor = vec4(background, 1.0);
+        return;
+    }
+    // Mean color of the pixel, brighter the denser it is
+    float t = log(1.0 + d.a) / log(1.0 + uintBitsToFloat(maxDensity));
+    float v = tone == 2 ? cdf[min(int(256.0 * t), 255)] : t;
+    FragColor = vec4(mix(background, d.rgb / d.a, v), 1.0);
+}
@@ -1,17 +1,24 @@
 #version 460 core
 layout (location = 0) in vec2 vPos; // Vertex position
 layout (location = 1) in vec2 cPos; // Center position (circle)
-layout (location = 2) in vec3 color;
+layout (location = 2) in int aggregateCommunity; // Community of the instance when level < 0
 layout (location = 3) in float size;
 uniform mat2 rotation;
 uniform vec2 translation;
+uniform vec4 box;        // Quantization box of the centers : min, size
+uniform float sizeScale; // Largest size when sizes are quantized
+uniform isamplerBuffer communities; // Community of every vertex, level after level
+uniform samplerBuffer palette;      // Color of every community
+uniform int level;  // -1 : the instances are aggregates of a level
+uniform int n_vtx;
 out float radius;
 out vec4 vertexColor;
 out vec2 pos;
 
 void main(){
-    radius = size; // constant for now, can be in the layout later
-    gl_Position = vec4(rotation * (radius* vPos + cPos) + translation, 0.0, 1.0);
-    vertexColor = vec4(color, 1.0);
+    radius = size * sizeScale; // constant for now, can be in the layout later
+    gl_Position = vec4(rotation * (radius* vPos + box.xy + box.zw * cPos) + translation, 0.0, 1.0);
+    int community = level < 0 ? aggregateCommunity : texelFetch(communities, level * n_vtx + gl_InstanceID).r;
+    vertexColor = vec4(texelFetch(palette, community).rgb, 1.0);
     pos = vPos;
 }
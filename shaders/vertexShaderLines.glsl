@@ -1,8 +1,39 @@
 #version 460 core
-layout (location = 0) in vec2 vPos; // Vertex position
+layout (location = 0) in uvec2 ends;  // Vertices linked by the edge
+layout (location = 1) in float weight;
 uniform mat2 rotation;
 uniform vec2 translation;
+uniform vec4 box;                // Quantization box of the positions : min, size
+uniform samplerBuffer positions; // Position of every vertex
+uniform vec2 viewport;           // Size in pixels
+uniform float lineWidth;         // Width in pixels of an edge of weight 1 / weightScale
+uniform float weightScale;
+uniform float opacity;
+noperspective out float offset;  // Distance to the center of the edge, in pixels
+flat out float halfWidth;
+flat out float alpha;
+
+// Quad of an edge as two triangles : (along the edge, side)
+const vec2 corners[6] = vec2[](vec2(0.0, -1.0), vec2(1.0, -1.0), vec2(0.0, 1.0),
+                               vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(0.0, 1.0));
 
 void main(){
-    gl_Position = vec4(rotation * vPos + translation, 0.0, 1.0);
+    vec2 corner = corners[gl_VertexID];
+    vec2 p0 = rotation * (box.xy + box.zw * texelFetch(positions, int(ends.x)).rg) + translation;
+    vec2 p1 = rotation * (box.xy + box.zw * texelFetch(positions, int(ends.y)).rg) + translation;
+
+    // Expanded in pixels around the segment
+    vec2 s0 = 0.5 * viewport * p0;
+    vec2 s1 = 0.5 * viewport * p1;
+    float len = length(s1 - s0);
+    vec2 dir = len > 0.0 ? (s1 - s0) / len : vec2(1.0, 0.0);
+    vec2 normal = vec2(-dir.y, dir.x);
+
+    // Edges thinner than a pixel are drawn one pixel wide with their coverage as opacity
+    float width = lineWidth * clamp(sqrt(weight * weightScale), 0.25, 4.0);
+    alpha = opacity * min(width, 1.0);
+    halfWidth = 0.5 * max(width, 1.0);
+    // One more pixel on each side for the anti-aliasing
+    offset = corner.y * (halfWidth + 1.0);
+    gl_Position = vec4((mix(s0, s1, corner.x) + offset * normal) / (0.5 * viewport), 0.0, 1.0);
 }
@@ -0,0 +1,8 @@
+#version 460 core
+out vec2 uv;
+
+// Triangle covering the screen, from the index of its vertex
+void main(){
+    uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(2.0 * uv - 1.0, 0.0, 1.0);
+}
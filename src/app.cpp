@@ -1,6 +1,13 @@
 #include "headers/app.hpp"
 #include "headers/shader_functions.hpp"
+#include "headers/thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <utility>
 #include <stdio.h>
 
 App::App(){}
@@ -10,7 +17,7 @@ int App::init(const char* fedges, const char* fpart){
         printf("Failed to initialize glfw\n");
         return -1;
     }
-    glfwWindowHint(GLFW_SAMPLES, 1); // 1x antialiasing
+    glfwWindowHint(GLFW_SAMPLES, 0); // Single sample : the cached scene is blitted to it
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -58,6 +65,16 @@ int App::compileShaders(){
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
+    // Density mode : histogram of the densities, then tone mapping in a full screen pass
+    GLuint computeShader = loadShaders("./shaders/computeShaderDensity.glsl", GL_COMPUTE_SHADER);
+    densityProgram = loadComputeProgram(computeShader);
+    glDeleteShader(computeShader);
+    GLuint vertexShaderScreen = loadShaders("./shaders/vertexShaderScreen.glsl", GL_VERTEX_SHADER);
+    GLuint fragmentShaderTone = loadShaders("./shaders/fragmentShaderTone.glsl", GL_FRAGMENT_SHADER);
+    toneShaderProgram = loadProgram(vertexShaderScreen, fragmentShaderTone);
+    glDeleteShader(vertexShaderScreen);
+    glDeleteShader(fragmentShaderTone);
+
     return 0;
 }
 
@@ -69,7 +86,7 @@ void App::loadOpenGLObjects(){
 
     // Create the VBO
     glGenBuffers(4, VBO);
-    GLuint vtx = VBO[0], color = VBO[1], pos = VBO[2], size = VBO[3];
+    GLuint vtx = VBO[0], pos = VBO[2], size = VBO[3];
 
     // Base shape for drawing the nodes
     // This does not need an EBO :
@@ -88,14 +105,6 @@ void App::loadOpenGLObjects(){
        -1.0f,  1.0f
     };
 
-    generateColors();
-    for (size_t i = 0; i < g->n_vtx; i++) {
-        int community = g->hierarchies[g->curr_hierarchy][i];
-        g->colors[3*i]   = colors[3*community];
-        g->colors[3*i+1] = colors[3*community+1];
-        g->colors[3*i+2] = colors[3*community+2];
-    }
-
     // Copy vertices data into the buffer
     glBindBuffer(GL_ARRAY_BUFFER, vtx);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
@@ -104,78 +113,426 @@ void App::loadOpenGLObjects(){
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    // Attribute related to the pos buffer
+    // Attribute related to the pos buffer : immutable storage for the ring of positions,
+    // written through the persistent mapping without any reallocation
     glBindBuffer(GL_ARRAY_BUFFER, pos);
-    glBufferData(GL_ARRAY_BUFFER, g->n_vtx*2*sizeof(float), &g->pos[0], GL_STREAM_DRAW);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)0);
+    // The segments are also read by the edges through a buffer texture, their offsets are aligned for it
+    const size_t stride = positionBytes();
+    GLint alignment = 1;
+    glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    segmentBytes = (std::max(g->n_vtx, (size_t) 1)*stride + alignment - 1) / alignment * alignment;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, n_segments*segmentBytes, NULL, flags);
+    posRing = (unsigned char*) glMapBufferRange(GL_ARRAY_BUFFER, 0, n_segments*segmentBytes, flags);
+    computeBounds();
+    if (compactAttributes) fitBox(true);
+    for (int s = 0; s < n_segments; s++) {
+        writePositions(posRing + s*segmentBytes, 0, g->n_vtx);
+        segmentBox[s] = box;
+    }
+    sentPos = g->pos;
+    movedFrame.assign(g->n_vtx, 0);
+    if (compactAttributes) glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+    else glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
     glVertexAttribDivisor(1, 1);
     glEnableVertexAttribArray(1);
 
-    // Attribute related to the color buffer
-    glBindBuffer(GL_ARRAY_BUFFER, color);
-    glBufferData(GL_ARRAY_BUFFER, g->n_vtx*3*sizeof(float), &g->colors[0], GL_STATIC_READ);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_TRUE, 3*sizeof(float), (void*)0);
-    glVertexAttribDivisor(2, 1);
-    glEnableVertexAttribArray(2);
+    loadCommunities();
 
     // Attribute related to the size buffer
     glBindBuffer(GL_ARRAY_BUFFER, size);
-    glBufferData(GL_ARRAY_BUFFER, g->n_vtx*sizeof(float), &g->wDeg[0], GL_STATIC_READ);
-    glVertexAttribPointer(3, 1, GL_FLOAT, GL_TRUE, sizeof(float), (void*)0);
+    if (compactAttributes) {
+        // Fractions of the largest size, the smallest vertices keep 1/255 of it to stay visible
+        sizeScale = 0.0f;
+        for (const float w : g->wDeg) sizeScale = std::max(sizeScale, w);
+        if (sizeScale <= 0.0f) sizeScale = 1.0f;
+        std::vector<GLubyte> sizes(g->n_vtx);
+        for (size_t i = 0; i < g->n_vtx; i++) sizes[i] = (GLubyte) std::max(1.0f, std::min(255.0f, g->wDeg[i] / sizeScale * 255.0f + 0.5f));
+        glBufferData(GL_ARRAY_BUFFER, g->n_vtx*sizeof(GLubyte), sizes.data(), GL_STATIC_READ);
+        glVertexAttribPointer(3, 1, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GLubyte), (void*)0);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, g->n_vtx*sizeof(float), &g->wDeg[0], GL_STATIC_READ);
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_TRUE, sizeof(float), (void*)0);
+    }
     glVertexAttribDivisor(3, 1);
     glEnableVertexAttribArray(3);
 
     // ================ OpenGL objects related to edges ===================
+    // Every edge is an instance of a quad, its ends and weight are attributes. The buffers are
+    // changed for every draw : all the edges, the edges in view or the edges between aggregates.
     glBindVertexArray(VAO[1]);
-   
-    glGenBuffers(1, EBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO[0]);
-    
+    glGenBuffers(2, edgeVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, edgeVBO[0]);
+    glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, 2*sizeof(GLuint), (void*)0);
+    glVertexAttribDivisor(0, 1);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, edgeVBO[1]);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(1);
+
 
-    unsigned int *edges = new unsigned int[2*g->n_edges];
-    int k = 0;
+    // Edges sorted once by importance, so that the most important ones are a prefix of the buffer :
+    // heavier first, the edges between communities of the coarsest level counting double, then
+    // the edges between the vertices of largest degrees, then the order of the CSR
+    int coarsest = -1;
+    for (size_t l = 0; l < aggregates.size(); l++) {
+        if (coarsest < 0 || aggregates[l].n_aggregates < aggregates[coarsest].n_aggregates) coarsest = l;
+    }
+    auto community = [&](size_t i){
+        const std::vector<int>& hierarchy = g->hierarchies[coarsest];
+        return i < hierarchy.size() ? std::max(hierarchy[i], 0) : 0;
+    };
+    std::vector<unsigned int> ends;
+    std::vector<float> weights, importance, degrees;
     for (unsigned int i = 0; i < g->n_vtx; i++){
-        for (int j = g->rowstart[i]; j < g->rowstart[i+1]; j++){
+        for (size_t j = g->rowstart[i]; j < g->rowstart[i+1]; j++){
             unsigned int neig = g->adj[j];
             if (neig > i){
-                edges[k++] = i;
-                edges[k++] = neig;
+                ends.push_back(i);
+                ends.push_back(neig);
+                weights.push_back((float) g->adjw[j]);
+                const bool between = coarsest >= 0 && community(i) != community(neig);
+                importance.push_back((between ? 2.0f : 1.0f) * (float) g->adjw[j]);
+                degrees.push_back(g->wDeg[i] + g->wDeg[neig]);
             }
         }
     }
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 2*g->n_edges*sizeof(unsigned int), edges, GL_STATIC_READ);
+    n_lines = importance.size();
+    std::vector<size_t> order(n_lines);
+    for (size_t e = 0; e < n_lines; e++) order[e] = e;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+        if (importance[a] != importance[b]) return importance[a] > importance[b];
+        return degrees[a] > degrees[b];
+    });
+    std::vector<unsigned int> edges(2*n_lines);
+    std::vector<float> edgeWeights(n_lines);
+    meanWeight = 0.0f;
+    for (size_t e = 0; e < n_lines; e++){
+        edges[2*e] = ends[2*order[e]];
+        edges[2*e+1] = ends[2*order[e]+1];
+        edgeWeights[e] = weights[order[e]];
+        meanWeight += weights[e] / n_lines;
+    }
+    glNamedBufferData(edgeVBO[0], std::max(edges.size(), (size_t) 1)*sizeof(GLuint), edges.data(), GL_STATIC_DRAW);
+    glNamedBufferData(edgeVBO[1], std::max(edgeWeights.size(), (size_t) 1)*sizeof(float), edgeWeights.data(), GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ARRAY_BUFFER, pos);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*) 0);
-    glEnableVertexAttribArray(0);
+    // Positions of the segment of the ring in use, as read by the edges
+    glCreateTextures(GL_TEXTURE_BUFFER, 1, &positionTexture);
+    bindPositionTexture();
 
-    delete [] edges;
+    // Density mode : largest density, number of pixels drawn, histogram and cumulative histogram
+    glCreateVertexArrays(1, &screenVAO);
+    glCreateBuffers(1, &histogramBuffer);
+    glNamedBufferStorage(histogramBuffer, (2 + 2*n_densityBins)*sizeof(GLuint), NULL, GL_DYNAMIC_STORAGE_BIT);
 }
 
 void App::draw(){
 
+    // Once the layout converged the simulation sleeps until woken up
+    bool moved = false;
     if (!paused) {
-        for (int i = 0; i < 10; i++) g->step();
+        for (int i = 0; i < 10 && !g->convergence.converged; i++) {
+            g->step();
+            moved = true;
+        }
     }
     computeTransform();
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[2]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 2 * g->n_vtx, &g->pos[0], GL_STREAM_DRAW);
+    // The first frame also picks up the positions set up before it, without any step
+    uploadPositions(moved || uploadFrame == 0);
+
+    // The camera is idle once the view stayed the same for idleDelay seconds
+    const std::array<float, 4> view = viewRect();
+    const double now = glfwGetTime();
+    if (view != lastView) {
+        lastView = view;
+        lastCameraMove = now;
+    }
+    const bool interacting = now - lastCameraMove < idleDelay;
+
+    // The scene is drawn into sceneFBO, then copied to the framebuffer bound by the caller. It is only
+    // drawn again when the positions, the hierarchy level, the camera or the size of the view changed.
+    GLint target = 0, viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] > 0 && viewport[3] > 0) {
+        if (viewport[2] != sceneWidth || viewport[3] != sceneHeight) resizeScene(viewport[2], viewport[3]);
+        if (!sceneValid || sceneFrame != uploadFrame || sceneView != view || sceneLevel != g->curr_hierarchy || sceneInteracting != interacting) {
+            glViewport(0, 0, sceneWidth, sceneHeight);
+            if (density != DENSITY_NONE) drawDensity(view, interacting);
+            else {
+                glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+                glClear(GL_COLOR_BUFFER_BIT);
+                drawScene(view, interacting);
+            }
 
-    // Draw lines
-    glUseProgram(lineShaderProgram);
-    glUniformMatrix2fv(glGetUniformLocation(lineShaderProgram, "rotation"), 1, false, &sceneMVP[0]);
-    glUniform2f(glGetUniformLocation(lineShaderProgram, "translation"), translationX, translationY);
-    glBindVertexArray(VAO[1]);
-    glDrawElements(GL_LINES, g->n_edges, GL_UNSIGNED_INT, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, target);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            sceneValid = true;
+            sceneFrame = uploadFrame;
+            sceneView = view;
+            sceneLevel = g->curr_hierarchy;
+            sceneInteracting = interacting;
+            statRenders++;
+        }
+        glBlitNamedFramebuffer(sceneFBO, target, 0, 0, sceneWidth, sceneHeight, viewport[0], viewport[1],
+                               viewport[0] + viewport[2], viewport[1] + viewport[3], GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+
+    if (segmentFence[segment]) glDeleteSync(segmentFence[segment]);
+    segmentFence[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    statFrames++;
+    if (instrumentation) reportStats();
+}
+
+// Nothing changes on screen until an event comes : the layout is not computed, the camera is idle
+// and the scene is cached
+bool App::idle() const {
+    return sceneValid && !sceneInteracting && (paused || g->convergence.converged);
+}
+
+// Cache of the scene at the size of the view
+void App::resizeScene(int width, int height){
+    if (sceneFBO) {
+        glDeleteFramebuffers(1, &sceneFBO);
+        glDeleteTextures(1, &sceneTexture);
+    }
+    glCreateTextures(GL_TEXTURE_2D, 1, &sceneTexture);
+    glTextureStorage2D(sceneTexture, 1, GL_RGBA8, width, height);
+    glCreateFramebuffers(1, &sceneFBO);
+    glNamedFramebufferTexture(sceneFBO, GL_COLOR_ATTACHMENT0, sceneTexture, 0);
+
+    if (density != DENSITY_NONE) {
+        if (densityFBO) {
+            glDeleteFramebuffers(1, &densityFBO);
+            glDeleteTextures(1, &densityTexture);
+        }
+        glCreateTextures(GL_TEXTURE_2D, 1, &densityTexture);
+        glTextureStorage2D(densityTexture, 1, GL_RGBA32F, width, height);
+        glTextureParameteri(densityTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(densityTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glCreateFramebuffers(1, &densityFBO);
+        glNamedFramebufferTexture(densityFBO, GL_COLOR_ATTACHMENT0, densityTexture, 0);
+    }
+    sceneWidth = width;
+    sceneHeight = height;
+    sceneValid = false;
+}
+
+// Draw the aggregates, the vertices in view or the whole graph. The aggregates would hide
+// the density, they are not drawn in density mode.
+void App::drawScene(const std::array<float, 4>& view, bool interacting){
+    const int level = density == DENSITY_NONE ? lodLevel() : -1;
+    if (level >= 0) drawAggregates(level);
+    else if (culling && cullView(view)) drawCulled(view);
+    else drawGraph(interacting && edgeBudget > 0 ? std::min(edgeBudget, n_lines) : n_lines);
+}
+
+// Sum the colors of the scene weighted by their opacity in densityTexture, the opacity summing to the
+// density, then tone map it to sceneFBO. The densities are scaled by log(1 + d) / log(1 + max), and
+// equalized with their histogram on this scale with DENSITY_HISTOGRAM.
+void App::drawDensity(const std::array<float, 4>& view, bool interacting){
+    const float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glBindFramebuffer(GL_FRAMEBUFFER, densityFBO);
+    glClearNamedFramebufferfv(densityFBO, GL_COLOR, 0, zero);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glProgramUniform1i(lineShaderProgram, glGetUniformLocation(lineShaderProgram, "density"), 1);
+    drawScene(view, interacting);
+    glProgramUniform1i(lineShaderProgram, glGetUniformLocation(lineShaderProgram, "density"), 0);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Largest density, then histogram and its cumulative sum
+    glClearNamedBufferData(histogramBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, histogramBuffer);
+    glUseProgram(densityProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, densityTexture);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    const int n_passes = density == DENSITY_HISTOGRAM ? 3 : 1;
+    for (int pass = 0; pass < n_passes; pass++){
+        glUniform1i(glGetUniformLocation(densityProgram, "pass"), pass);
+        if (pass < 2) glDispatchCompute((sceneWidth + 15) / 16, (sceneHeight + 15) / 16, 1);
+        else glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // Full screen pass over the background
+    float background[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, background);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    glUseProgram(toneShaderProgram);
+    glUniform1i(glGetUniformLocation(toneShaderProgram, "tone"), density);
+    glUniform3fv(glGetUniformLocation(toneShaderProgram, "background"), 1, background);
+    glBindVertexArray(screenVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// Draw every vertex and the n_draw most important edges
+void App::drawGraph(size_t n_draw){
+    drawEdges(edgeVBO, positionTexture, &segmentBox[segment][0], 1.0f / meanWeight, 0.1f, n_draw);
 
     glUseProgram(nodeShaderProgram);
     glUniformMatrix2fv(glGetUniformLocation(nodeShaderProgram, "rotation"), 1, false, &sceneMVP[0]);
     glUniform2f(glGetUniformLocation(nodeShaderProgram, "translation"), translationX, translationY);
+    glUniform4fv(glGetUniformLocation(nodeShaderProgram, "box"), 1, &segmentBox[segment][0]);
+    glUniform1f(glGetUniformLocation(nodeShaderProgram, "sizeScale"), sizeScale);
+    glUniform1i(glGetUniformLocation(nodeShaderProgram, "level"), g->curr_hierarchy);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, TEX[0]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, TEX[1]);
 
     glBindVertexArray(VAO[0]);
     glDrawArraysInstanced(GL_TRIANGLES, 0, 12, g->n_vtx);
 }
 
+// Bring the next segment of the ring up to date and point both VAOs to it. The segment was
+// written n_segments uploads ago : the runs of vertices that moved since then are copied,
+// or all of them when the quantization box changed since.
+void App::uploadPositions(bool moved){
+    if (!moved) return;
+    uploadFrame++;
+    segment = (segment + 1) % n_segments;
+    if (segmentFence[segment]) {
+        // Only waits if the GPU is n_segments frames late
+        while (glClientWaitSync(segmentFence[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(segmentFence[segment]);
+        segmentFence[segment] = 0;
+    }
+
+    computeBounds();
+    if (compactAttributes && fitBox(false)) boxFrame = uploadFrame;
+    const unsigned int written = segmentFrame[segment];
+    const bool full = written < boxFrame;
+    const size_t stride = positionBytes();
+    unsigned char* dst = posRing + segment*segmentBytes;
+    const size_t blockSize = 1 << 16;
+    const size_t n_blocks = (g->n_vtx + blockSize - 1) / blockSize;
+    std::vector<size_t> blockBytes(n_blocks);
+    threadPool().blocks(g->n_vtx, blockSize, [&](size_t b, size_t begin, size_t end){
+        const float* pos = &g->pos[0];
+        size_t bytes = 0, run = begin;
+        for (size_t i = begin; i <= end; i++){
+            if (i < end) {
+                if (pos[2*i] != sentPos[2*i] || pos[2*i+1] != sentPos[2*i+1]) {
+                    sentPos[2*i] = pos[2*i];
+                    sentPos[2*i+1] = pos[2*i+1];
+                    movedFrame[i] = uploadFrame;
+                }
+                if (full || movedFrame[i] > written) continue;
+            }
+            // End of a run of vertices to copy
+            if (i > run) {
+                writePositions(dst, run, i);
+                bytes += (i - run)*stride;
+            }
+            run = i + 1;
+        }
+        blockBytes[b] = bytes;
+    });
+    for (const size_t bytes : blockBytes) statUploadBytes += bytes;
+    segmentFrame[segment] = uploadFrame;
+    segmentBox[segment] = box;
+
+    glVertexArrayVertexBuffer(VAO[0], 1, VBO[2], segment*segmentBytes, stride);
+    bindPositionTexture();
+}
+
+// Point the buffer texture of the positions to the segment in use
+void App::bindPositionTexture(){
+    if (g->n_vtx == 0) return;
+    glTextureBufferRange(positionTexture, compactAttributes ? GL_RG16 : GL_RG32F, VBO[2], segment*segmentBytes, g->n_vtx*positionBytes());
+}
+
+// Draw the edges of the buffers vbo (0: ends, 1: weights) as instanced quads, their ends are read from
+// the buffer texture positions, in the box. A weight of 1 / weightScale is drawn lineWidth pixels wide.
+void App::drawEdges(const GLuint* vbo, GLuint positions, const float* edgeBox, float weightScale, float opacity, size_t count){
+    glUseProgram(lineShaderProgram);
+    glUniformMatrix2fv(glGetUniformLocation(lineShaderProgram, "rotation"), 1, false, &sceneMVP[0]);
+    glUniform2f(glGetUniformLocation(lineShaderProgram, "translation"), translationX, translationY);
+    glUniform4fv(glGetUniformLocation(lineShaderProgram, "box"), 1, edgeBox);
+    glUniform2f(glGetUniformLocation(lineShaderProgram, "viewport"), (float) sceneWidth, (float) sceneHeight);
+    glUniform1f(glGetUniformLocation(lineShaderProgram, "lineWidth"), lineWidth);
+    glUniform1f(glGetUniformLocation(lineShaderProgram, "weightScale"), weightScale);
+    glUniform1f(glGetUniformLocation(lineShaderProgram, "opacity"), opacity);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, positions);
+    glVertexArrayVertexBuffer(VAO[1], 0, vbo[0], 0, 2*sizeof(GLuint));
+    glVertexArrayVertexBuffer(VAO[1], 1, vbo[1], 0, sizeof(float));
+    glBindVertexArray(VAO[1]);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+}
+
+// Bytes of the position of a vertex in the ring
+size_t App::positionBytes() const {
+    return compactAttributes ? 2*sizeof(GLushort) : 2*sizeof(float);
+}
+
+// Bounds of the positions
+void App::computeBounds(){
+    const size_t blockSize = 1 << 16;
+    const size_t n_blocks = (g->n_vtx + blockSize - 1) / blockSize;
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<std::array<float, 4>> blockBounds(n_blocks, std::array<float, 4>{{inf, inf, -inf, -inf}});
+    threadPool().blocks(g->n_vtx, blockSize, [&](size_t b, size_t begin, size_t end){
+        std::array<float, 4>& bb = blockBounds[b];
+        for (size_t i = begin; i < end; i++){
+            bb[0] = std::min(bb[0], g->pos[2*i]);
+            bb[1] = std::min(bb[1], g->pos[2*i+1]);
+            bb[2] = std::max(bb[2], g->pos[2*i]);
+            bb[3] = std::max(bb[3], g->pos[2*i+1]);
+        }
+    });
+    if (n_blocks == 0) return;
+    bounds = blockBounds[0];
+    for (const std::array<float, 4>& bb : blockBounds){
+        bounds[0] = std::min(bounds[0], bb[0]); bounds[1] = std::min(bounds[1], bb[1]);
+        bounds[2] = std::max(bounds[2], bb[2]); bounds[3] = std::max(bounds[3], bb[3]);
+    }
+}
+
+// Fit the quantization box around the bounds, with a margin of 1/8 of their extent on every side,
+// when forced, when a vertex left the box or when the positions fill less than half of it.
+// Returns true when the box changed.
+bool App::fitBox(bool force){
+    const std::array<float, 4>& bb = bounds;
+    const float extent = std::max(std::max(bb[2] - bb[0], bb[3] - bb[1]), 1e-6f);
+    const bool inside = bb[0] >= box[0] && bb[1] >= box[1] && bb[2] <= box[0] + box[2] && bb[3] <= box[1] + box[3];
+    if (!force && inside && 2.0f*extent >= box[2]) return false;
+
+    const float side = 1.25f*extent;
+    box = {{0.5f*(bb[0] + bb[2] - side), 0.5f*(bb[1] + bb[3] - side), side, side}};
+    return true;
+}
+
+// Write the positions of the vertices [begin, end) to the segment dst, quantized in the box when compact
+void App::writePositions(unsigned char* dst, size_t begin, size_t end) const {
+    const float* pos = &g->pos[0];
+    if (!compactAttributes) {
+        memcpy(dst + begin*2*sizeof(float), pos + 2*begin, (end - begin)*2*sizeof(float));
+        return;
+    }
+    GLushort* q = (GLushort*) dst;
+    const float sx = 65535.0f / box[2], sy = 65535.0f / box[3];
+    for (size_t i = begin; i < end; i++){
+        q[2*i] = (GLushort) std::max(0.0f, std::min(65535.0f, (pos[2*i] - box[0])*sx + 0.5f));
+        q[2*i+1] = (GLushort) std::max(0.0f, std::min(65535.0f, (pos[2*i+1] - box[1])*sy + 0.5f));
+    }
+}
+
+void App::reportStats(){
+    const double now = glfwGetTime();
+    if (statStart == 0.0) statStart = now;
+    if (now - statStart < 1.0) return;
+    printf("%.1f fps, %.1f renders/s, uploads %.1f KB/frame\n", statFrames / (now - statStart), statRenders / (now - statStart),
+           statUploadBytes / 1024.0 / std::max(statFrames, (size_t) 1));
+    statFrames = 0;
+    statRenders = 0;
+    statUploadBytes = 0;
+    statStart = now;
+}
+
 void App::computeTransform(){
     const float s = 0.0f; 
     const float c = 1.0f;
@@ -183,22 +540,396 @@ void App::computeTransform(){
     sceneMVP[2] = zoom * aspectRatio * s; sceneMVP[3] = zoom * c;
 }
 
-void App::generateColors(){
-    colors.reserve(3*g->n_vtx);
-    for (int i = 0; i < 3*g->n_vtx; i++) colors[i] = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+void App::generateColors(size_t n_colors){
+    colors.resize(3*n_colors);
+    for (size_t i = 0; i < 3*n_colors; i++) colors[i] = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+}
+
+// Upload the communities of every level and the palette once, as buffer textures
+void App::loadCommunities(){
+    const size_t n_levels = std::max(g->hierarchies.size(), (size_t) 1);
+    std::vector<GLint> communities(n_levels*g->n_vtx, 0);
+    GLint max_community = 0;
+    for (size_t l = 0; l < g->hierarchies.size(); l++){
+        const size_t n = std::min(g->hierarchies[l].size(), g->n_vtx);
+        for (size_t i = 0; i < n; i++) {
+            communities[l*g->n_vtx + i] = std::max(g->hierarchies[l][i], 0);
+            max_community = std::max(max_community, communities[l*g->n_vtx + i]);
+        }
+    }
+    generateColors(std::max(g->n_vtx, (size_t) max_community + 1));
+
+    // Number of communities of every level, to choose the level of detail before any aggregate is built
+    aggregates.resize(g->hierarchies.size());
+    std::vector<char> seen(max_community + 1);
+    for (size_t l = 0; l < g->hierarchies.size(); l++){
+        std::fill(seen.begin(), seen.end(), 0);
+        for (size_t i = 0; i < g->n_vtx; i++) {
+            char& s = seen[communities[l*g->n_vtx + i]];
+            aggregates[l].n_aggregates += !s;
+            s = 1;
+        }
+    }
+
+    GLint max_texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    if (communities.size() > (size_t) max_texels) {
+        printf("%zu communities exceed the %d texels of a buffer texture\n", communities.size(), max_texels);
+    }
+
+    glGenTextures(2, TEX);
+    glBindBuffer(GL_TEXTURE_BUFFER, VBO[1]);
+    glBindTexture(GL_TEXTURE_BUFFER, TEX[0]);
+    if (compactAttributes && max_community <= std::numeric_limits<GLshort>::max()) {
+        std::vector<GLshort> shortCommunities(communities.begin(), communities.end());
+        glBufferData(GL_TEXTURE_BUFFER, std::max(communities.size(), (size_t) 1)*sizeof(GLshort), shortCommunities.data(), GL_STATIC_DRAW);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R16I, VBO[1]);
+    } else {
+        glBufferData(GL_TEXTURE_BUFFER, std::max(communities.size(), (size_t) 1)*sizeof(GLint), communities.data(), GL_STATIC_DRAW);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, VBO[1]);
+    }
+
+    glGenBuffers(1, &paletteBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, colors.size()*sizeof(float), colors.data(), GL_STATIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, TEX[1]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, paletteBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glUseProgram(nodeShaderProgram);
+    glUniform1i(glGetUniformLocation(nodeShaderProgram, "communities"), 0);
+    glUniform1i(glGetUniformLocation(nodeShaderProgram, "palette"), 1);
+    glUniform1i(glGetUniformLocation(nodeShaderProgram, "n_vtx"), (GLint) g->n_vtx);
+}
+
+// Level of the hierarchy to draw, -1 for every vertex : among the levels whose communities are on
+// average at least lodSpacing pixels apart, the one with the most communities, else the coarsest one
+int App::lodLevel() const {
+    if (lodSpacing <= 0.0f || aggregates.empty()) return -1;
+    const float scale = zoom * viewHeight / 2.0f; // Pixels per unit of the layout
+    const float area = std::max((bounds[2] - bounds[0])*(bounds[3] - bounds[1]), 1e-12f) * scale*scale;
+    auto spacing = [&](size_t count){ return std::sqrt(area / std::max(count, (size_t) 1)); };
+    if (spacing(g->n_vtx) >= lodSpacing) return -1;
+
+    int level = -1, coarsest = 0;
+    for (size_t l = 0; l < aggregates.size(); l++){
+        const size_t count = aggregates[l].n_aggregates;
+        if (count < aggregates[coarsest].n_aggregates) coarsest = l;
+        if (spacing(count) >= lodSpacing && (level < 0 || count > aggregates[level].n_aggregates)) level = l;
+    }
+    return level < 0 ? coarsest : level;
+}
+
+// Draw the aggregates of a level and the edges between them
+void App::drawAggregates(int level){
+    Aggregates& agg = aggregates[level];
+    if (!agg.built) buildAggregates(agg, level);
+    updateAggregates(agg);
 
+    const float identity[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+    drawEdges(&agg.VBO[3], agg.TEX, identity, 1.0f / agg.meanWeight, 0.3f, agg.n_edges);
+
+    drawInstances(agg.VAO, agg.n_aggregates);
 }
 
-void App::updateColors(){
-    glBindVertexArray(VAO[1]);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
-    
-    for (size_t i = 0; i < g->n_vtx; i++) {
-        int community = g->hierarchies[g->curr_hierarchy][i];
-        g->colors[3*i]   = colors[3*community];
-        g->colors[3*i+1] = colors[3*community+1];
-        g->colors[3*i+2] = colors[3*community+2];
+// VAO of nodes given instance by instance, the buffers vbo hold 0: centers, 1: sizes, 2: communities
+void App::createInstances(GLuint& vao, const GLuint* vbo){
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)0);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
+    glVertexAttribIPointer(2, 1, GL_INT, sizeof(GLint), (void*)0);
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(2);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(3);
+}
+
+// Draw count nodes of a VAO made by createInstances : positions and sizes are neither quantized
+// nor scaled, the community of every instance is an attribute
+void App::drawInstances(GLuint vao, size_t count){
+    const float identity[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+    glUseProgram(nodeShaderProgram);
+    glUniformMatrix2fv(glGetUniformLocation(nodeShaderProgram, "rotation"), 1, false, &sceneMVP[0]);
+    glUniform2f(glGetUniformLocation(nodeShaderProgram, "translation"), translationX, translationY);
+    glUniform4fv(glGetUniformLocation(nodeShaderProgram, "box"), 1, identity);
+    glUniform1f(glGetUniformLocation(nodeShaderProgram, "sizeScale"), 1.0f);
+    glUniform1i(glGetUniformLocation(nodeShaderProgram, "level"), -1);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, TEX[0]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, TEX[1]);
+    glBindVertexArray(vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+}
+
+// Group the vertices by community and sum the weights of the edges between every pair of communities
+void App::buildAggregates(Aggregates& agg, int level){
+    const std::vector<int>& hierarchy = g->hierarchies[level];
+    auto community = [&](size_t i){ return i < hierarchy.size() ? std::max(hierarchy[i], 0) : 0; };
+
+    // Aggregates numbered in order of first appearance
+    std::vector<size_t> dense(colors.size() / 3, SIZE_MAX);
+    agg.aggregate.resize(g->n_vtx);
+    for (size_t i = 0; i < g->n_vtx; i++){
+        size_t& a = dense[community(i)];
+        if (a == SIZE_MAX) {
+            a = agg.ids.size();
+            agg.ids.push_back(community(i));
+            agg.members.push_back(0.0f);
+        }
+        agg.aggregate[i] = a;
+        agg.members[a] += 1.0f;
+    }
+    agg.n_aggregates = agg.ids.size();
+
+    // Area of an aggregate : its number of members times the area of the average vertex
+    float meanSize = 0.0f;
+    for (const float w : g->wDeg) meanSize += w;
+    meanSize /= std::max(g->n_vtx, (size_t) 1);
+    std::vector<float> sizes(agg.n_aggregates);
+    for (size_t a = 0; a < agg.n_aggregates; a++) sizes[a] = meanSize * std::sqrt(agg.members[a]);
+
+    // Every edge between two aggregates is seen from its end in the smaller one
+    std::vector<std::pair<uint64_t, float>> pairs;
+    for (size_t i = 0; i < g->n_vtx; i++){
+        const uint64_t a = agg.aggregate[i];
+        for (size_t j = g->rowstart[i]; j < g->rowstart[i+1]; j++){
+            const uint64_t b = agg.aggregate[g->adj[j]];
+            if (a < b) pairs.push_back(std::make_pair(a*agg.n_aggregates + b, (float) g->adjw[j]));
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    std::vector<GLint> ends;
+    std::vector<float> weights;
+    for (size_t k = 0; k < pairs.size(); k++){
+        if (k == 0 || pairs[k].first != pairs[k-1].first) {
+            ends.push_back(pairs[k].first / agg.n_aggregates);
+            ends.push_back(pairs[k].first % agg.n_aggregates);
+            weights.push_back(0.0f);
+        }
+        weights.back() += pairs[k].second;
+    }
+    agg.n_edges = weights.size();
+    agg.meanWeight = 0.0f;
+    for (const float w : weights) agg.meanWeight += w / agg.n_edges;
+
+    // Nodes : base shape, centers, sizes and communities
+    agg.centers.assign(2*agg.n_aggregates, 0.0f);
+    glCreateBuffers(5, agg.VBO);
+    createInstances(agg.VAO, agg.VBO);
+    glNamedBufferData(agg.VBO[0], std::max(agg.centers.size(), (size_t) 1)*sizeof(float), agg.centers.data(), GL_DYNAMIC_DRAW);
+    glNamedBufferData(agg.VBO[1], std::max(sizes.size(), (size_t) 1)*sizeof(float), sizes.data(), GL_STATIC_DRAW);
+    glNamedBufferData(agg.VBO[2], std::max(agg.ids.size(), (size_t) 1)*sizeof(GLint), agg.ids.data(), GL_STATIC_DRAW);
+
+    // Edges, drawn as instances between the centers read from a buffer texture
+    glNamedBufferData(agg.VBO[3], std::max(ends.size(), (size_t) 1)*sizeof(GLint), ends.data(), GL_STATIC_DRAW);
+    glNamedBufferData(agg.VBO[4], std::max(weights.size(), (size_t) 1)*sizeof(float), weights.data(), GL_STATIC_DRAW);
+    glGenTextures(1, &agg.TEX);
+    glBindTexture(GL_TEXTURE_BUFFER, agg.TEX);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, agg.VBO[0]);
+
+    agg.built = true;
+}
+
+// Move the aggregates to the centroid of their members when the positions changed since
+void App::updateAggregates(Aggregates& agg){
+    if (agg.frame == uploadFrame) return;
+    agg.frame = uploadFrame;
+
+    std::fill(agg.centers.begin(), agg.centers.end(), 0.0f);
+    for (size_t i = 0; i < g->n_vtx; i++){
+        agg.centers[2*agg.aggregate[i]] += g->pos[2*i];
+        agg.centers[2*agg.aggregate[i]+1] += g->pos[2*i+1];
+    }
+    for (size_t a = 0; a < agg.n_aggregates; a++){
+        agg.centers[2*a] /= agg.members[a];
+        agg.centers[2*a+1] /= agg.members[a];
+    }
+    glNamedBufferSubData(agg.VBO[0], 0, agg.centers.size()*sizeof(float), agg.centers.data());
+}
+
+// Rectangle of the layout in view : min x, min y, max x, max y
+std::array<float, 4> App::viewRect() const {
+    const float sx = zoom * aspectRatio, sy = zoom;
+    return {{(-1.0f - translationX) / sx, (-1.0f - translationY) / sy, (1.0f - translationX) / sx, (1.0f - translationY) / sy}};
+}
+
+// True when less than half of the layout is in view
+bool App::cullView(const std::array<float, 4>& view) const {
+    const float w = std::min(view[2], bounds[2]) - std::max(view[0], bounds[0]);
+    const float h = std::min(view[3], bounds[3]) - std::max(view[1], bounds[1]);
+    const float area = (bounds[2] - bounds[0])*(bounds[3] - bounds[1]);
+    return g->n_vtx > 0 && (w <= 0.0f || h <= 0.0f || 2.0f*w*h < area);
+}
+
+static bool longEdge(const float* pos, size_t i, size_t j, float cell){
+    const float vx = pos[2*j] - pos[2*i];
+    const float vy = pos[2*j+1] - pos[2*i+1];
+    return vx*vx + vy*vy > cell*cell;
+}
+
+static bool nearRect(const std::array<float, 4>& rect, float x, float y, float margin){
+    return x >= rect[0] - margin && x <= rect[2] + margin && y >= rect[1] - margin && y <= rect[3] + margin;
+}
+
+// Sort the vertices by cell and list the long edges, both in parallel by blocks of vertices
+void App::buildGrid(){
+    grid.frame = uploadFrame;
+    const float* pos = &g->pos[0];
+    const float w = std::max(bounds[2] - bounds[0], 1e-6f);
+    const float h = std::max(bounds[3] - bounds[1], 1e-6f);
+    const size_t n_cells = std::max(g->n_vtx / Grid::verticesPerCell, (size_t) 1);
+    grid.cell = std::max(std::sqrt(w*h / n_cells), std::max(w, h) / n_cells);
+    grid.x0 = bounds[0];
+    grid.y0 = bounds[1];
+    grid.nx = (size_t) (w / grid.cell) + 1;
+    grid.ny = (size_t) (h / grid.cell) + 1;
+    grid.maxSize = 0.0f;
+    for (const float size : g->wDeg) grid.maxSize = std::max(grid.maxSize, size);
+
+    const size_t blockSize = 1 << 16;
+    const size_t n_blocks = (g->n_vtx + blockSize - 1) / blockSize;
+    std::vector<size_t> cellOf(g->n_vtx);
+    std::vector<std::vector<size_t>> blockEdges(n_blocks);
+    std::vector<std::vector<float>> blockWeights(n_blocks);
+    threadPool().blocks(g->n_vtx, blockSize, [&](size_t b, size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            const size_t cx = std::min((size_t) std::max(0.0f, (pos[2*i] - grid.x0) / grid.cell), grid.nx - 1);
+            const size_t cy = std::min((size_t) std::max(0.0f, (pos[2*i+1] - grid.y0) / grid.cell), grid.ny - 1);
+            cellOf[i] = cy*grid.nx + cx;
+            for (size_t j = g->rowstart[i]; j < g->rowstart[i+1]; j++){
+                const size_t neig = g->adj[j];
+                if (neig > i && longEdge(pos, i, neig, grid.cell)) {
+                    blockEdges[b].push_back(i);
+                    blockEdges[b].push_back(neig);
+                    blockWeights[b].push_back((float) g->adjw[j]);
+                }
+            }
+        }
+    });
+
+    grid.cellStart.assign(grid.nx*grid.ny + 1, 0);
+    for (const size_t c : cellOf) grid.cellStart[c+1]++;
+    for (size_t c = 0; c < grid.nx*grid.ny; c++) grid.cellStart[c+1] += grid.cellStart[c];
+    std::vector<size_t> next(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    grid.vertices.resize(g->n_vtx);
+    for (size_t i = 0; i < g->n_vtx; i++) grid.vertices[next[cellOf[i]]++] = i;
+
+    grid.longEdges.clear();
+    grid.longWeights.clear();
+    for (size_t b = 0; b < n_blocks; b++){
+        grid.longEdges.insert(grid.longEdges.end(), blockEdges[b].begin(), blockEdges[b].end());
+        grid.longWeights.insert(grid.longWeights.end(), blockWeights[b].begin(), blockWeights[b].end());
+    }
+}
+
+// Upload the vertices in view, in their order, and the edges that may cross it : the short edges
+// of the vertices within a cell of the view and the long edges whose bounding box meets it
+void App::queryGrid(const std::array<float, 4>& view){
+    culledView = view;
+    culledFrame = grid.frame;
+    culledLevel = g->curr_hierarchy;
+    if (stamp.size() != g->n_vtx) stamp.assign(g->n_vtx, 0);
+    if (++stampValue == 0) {
+        std::fill(stamp.begin(), stamp.end(), 0);
+        stampValue = 1;
+    }
+
+    const float* pos = &g->pos[0];
+    const float reach = std::max(grid.cell, grid.maxSize);
+    auto cellRange = [&](float lo, float hi, float origin, size_t n, size_t& first, size_t& last){
+        first = (size_t) std::min((float) (n - 1), std::max(0.0f, (lo - reach - origin) / grid.cell));
+        last = (size_t) std::min((float) (n - 1), std::max(0.0f, (hi + reach - origin) / grid.cell));
+    };
+    size_t cx0, cx1, cy0, cy1;
+    cellRange(view[0], view[2], grid.x0, grid.nx, cx0, cx1);
+    cellRange(view[1], view[3], grid.y0, grid.ny, cy0, cy1);
+
+    std::vector<size_t> visible, near;
+    for (size_t cy = cy0; cy <= cy1; cy++){
+        for (size_t cx = cx0; cx <= cx1; cx++){
+            const size_t c = cy*grid.nx + cx;
+            for (size_t k = grid.cellStart[c]; k < grid.cellStart[c+1]; k++){
+                const size_t i = grid.vertices[k];
+                if (nearRect(view, pos[2*i], pos[2*i+1], grid.cell)) {
+                    stamp[i] = stampValue;
+                    near.push_back(i);
+                }
+                if (nearRect(view, pos[2*i], pos[2*i+1], g->wDeg[i])) visible.push_back(i);
+            }
+        }
+    }
+    // Same drawing order as without culling
+    std::sort(visible.begin(), visible.end());
+
+    const bool hasLevel = g->curr_hierarchy >= 0 && (size_t) g->curr_hierarchy < g->hierarchies.size();
+    std::vector<float> centers(2*visible.size()), sizes(visible.size());
+    std::vector<GLint> communities(visible.size(), 0);
+    for (size_t k = 0; k < visible.size(); k++){
+        const size_t i = visible[k];
+        centers[2*k] = pos[2*i];
+        centers[2*k+1] = pos[2*i+1];
+        sizes[k] = g->wDeg[i];
+        if (hasLevel && i < g->hierarchies[g->curr_hierarchy].size()) communities[k] = std::max(g->hierarchies[g->curr_hierarchy][i], 0);
+    }
+
+    // An edge between two vertices near the view is taken from its smaller end
+    std::vector<GLuint> edges;
+    std::vector<float> weights;
+    for (const size_t i : near){
+        for (size_t j = g->rowstart[i]; j < g->rowstart[i+1]; j++){
+            const size_t neig = g->adj[j];
+            if (neig == i || longEdge(pos, i, neig, grid.cell)) continue;
+            if (stamp[neig] != stampValue || i < neig) {
+                edges.push_back(i);
+                edges.push_back(neig);
+                weights.push_back((float) g->adjw[j]);
+            }
+        }
+    }
+    for (size_t k = 0; k < grid.longEdges.size(); k += 2){
+        const size_t i = grid.longEdges[k], j = grid.longEdges[k+1];
+        if (std::max(pos[2*i], pos[2*j]) >= view[0] && std::min(pos[2*i], pos[2*j]) <= view[2] &&
+            std::max(pos[2*i+1], pos[2*j+1]) >= view[1] && std::min(pos[2*i+1], pos[2*j+1]) <= view[3]) {
+            edges.push_back(i);
+            edges.push_back(j);
+            weights.push_back(grid.longWeights[k/2]);
+        }
+    }
+
+    n_visibleVertices = visible.size();
+    n_visibleEdges = edges.size() / 2;
+    glNamedBufferData(cullVBO[0], centers.size()*sizeof(float), centers.data(), GL_STREAM_DRAW);
+    glNamedBufferData(cullVBO[1], sizes.size()*sizeof(float), sizes.data(), GL_STREAM_DRAW);
+    glNamedBufferData(cullVBO[2], communities.size()*sizeof(GLint), communities.data(), GL_STREAM_DRAW);
+    glNamedBufferData(cullEdgeVBO[0], edges.size()*sizeof(GLuint), edges.data(), GL_STREAM_DRAW);
+    glNamedBufferData(cullEdgeVBO[1], weights.size()*sizeof(float), weights.data(), GL_STREAM_DRAW);
+    statUploadBytes += (centers.size() + sizes.size() + weights.size())*sizeof(float) + (communities.size() + edges.size())*sizeof(GLint);
+}
+
+// Draw the vertices and edges in view
+void App::drawCulled(const std::array<float, 4>& view){
+    if (!cullVAO) {
+        glCreateBuffers(3, cullVBO);
+        glCreateBuffers(2, cullEdgeVBO);
+        createInstances(cullVAO, cullVBO);
     }
+    if (grid.frame != uploadFrame) buildGrid();
+    if (culledFrame != grid.frame || culledView != view || culledLevel != g->curr_hierarchy) queryGrid(view);
 
-    glBufferData(GL_ARRAY_BUFFER, g->n_vtx*3*sizeof(float), &g->colors[0], GL_STATIC_READ);
+    drawEdges(cullEdgeVBO, positionTexture, &segmentBox[segment][0], 1.0f / meanWeight, 0.1f, n_visibleEdges);
+    drawInstances(cullVAO, n_visibleVertices);
 }
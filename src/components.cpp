@@ -0,0 +1,95 @@
+#include "headers/components.hpp"
+#include "headers/graph.hpp"
+#include "headers/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Root of i, halving the path on the way
+static size_t findRoot(std::vector<std::atomic<size_t>>& parent, size_t i){
+    while (true) {
+        size_t p = parent[i].load(std::memory_order_relaxed);
+        if (p == i) return i;
+        const size_t gp = parent[p].load(std::memory_order_relaxed);
+        if (p != gp) parent[i].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+        i = gp;
+    }
+}
+
+// The larger root is linked below the smaller one, so that the final root is the
+// smallest vertex of the component whatever the order of the unions
+static void unite(std::vector<std::atomic<size_t>>& parent, size_t a, size_t b){
+    while (true) {
+        size_t ra = findRoot(parent, a);
+        size_t rb = findRoot(parent, b);
+        if (ra == rb) return;
+        if (ra < rb) std::swap(ra, rb);
+        size_t expected = ra;
+        if (parent[ra].compare_exchange_strong(expected, rb)) return;
+    }
+}
+
+size_t connectedComponents(const Graph& g, std::vector<size_t>& component){
+    const size_t n = g.n_vtx;
+    std::vector<std::atomic<size_t>> parent(n);
+    for (size_t i = 0; i < n; i++) parent[i].store(i, std::memory_order_relaxed);
+
+    threadPool().parallel_for(n, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            for (size_t j = g.rowstart[i]; j < g.rowstart[i+1]; j++){
+                if (g.adj[j] < i) unite(parent, i, g.adj[j]);
+            }
+        }
+    });
+
+    component.resize(n);
+    threadPool().parallel_for(n, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++) component[i] = findRoot(parent, i);
+    });
+
+    // Roots are the smallest vertex of each component : number them in order
+    size_t n_components = 0;
+    for (size_t i = 0; i < n; i++){
+        if (component[i] == i) component[i] = n_components++;
+        else component[i] = component[component[i]];
+    }
+    return n_components;
+}
+
+void packRectangles(const std::vector<float>& width, const std::vector<float>& height, std::vector<float>& x, std::vector<float>& y){
+    const size_t n = width.size();
+    x.resize(n);
+    y.resize(n);
+    if (n == 0) return;
+
+    double area = 0.0;
+    float maxWidth = 0.0f;
+    for (size_t i = 0; i < n; i++){
+        area += (double) width[i] * height[i];
+        maxWidth = std::max(maxWidth, width[i]);
+    }
+    const float shelfWidth = std::max(maxWidth, (float) std::sqrt(area));
+
+    // Fill shelves from left to right, a new shelf starts above the tallest item of the previous one
+    float cx = 0.0f, cy = 0.0f, shelfHeight = 0.0f, totalWidth = 0.0f;
+    for (size_t i = 0; i < n; i++){
+        if (cx > 0.0f && cx + width[i] > shelfWidth) {
+            cx = 0.0f;
+            cy += shelfHeight;
+            shelfHeight = 0.0f;
+        }
+        x[i] = cx + 0.5f * width[i];
+        y[i] = cy + 0.5f * height[i];
+        cx += width[i];
+        shelfHeight = std::max(shelfHeight, height[i]);
+        totalWidth = std::max(totalWidth, cx);
+    }
+
+    const float totalHeight = cy + shelfHeight;
+    for (size_t i = 0; i < n; i++){
+        x[i] -= 0.5f * totalWidth;
+        y[i] = 0.5f * totalHeight - y[i]; // First shelf at the top
+    }
+}
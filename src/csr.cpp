@@ -0,0 +1,122 @@
+#include "headers/csr.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(size_t) == sizeof(uint64_t), "The binary CSR format stores size_t as 64 bits values");
+
+static const char magic[8] = {'G', 'R', 'A', 'P', 'H', 'C', 'S', 'R'};
+static const uint64_t version = 1;
+static const size_t headerSize = 4 * sizeof(uint64_t);
+
+CSR::~CSR(){
+    unmap();
+}
+
+void CSR::unmap(){
+    if (mapping) munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+}
+
+void CSR::bind(){
+    unmap();
+    rowstartView.data = rowstart.data(); rowstartView.n = rowstart.size();
+    adjView.data = adj.data(); adjView.n = adj.size();
+    adjwView.data = adjw.data(); adjwView.n = adjw.size();
+}
+
+int CSR::map(const char* fname, size_t* nVtx, size_t* nEdges, std::vector<size_t>& vtxw){
+    const int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        printf("File : %s couldn't be opened\n", fname);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < headerSize) {
+        printf("%s is not a valid binary CSR file\n", fname);
+        close(fd);
+        return -1;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("File : %s couldn't be mapped\n", fname);
+        return -1;
+    }
+
+    const uint64_t* header = (const uint64_t*) data;
+    const size_t n = header[2];
+    const size_t m = header[3];
+    if (memcmp(data, magic, sizeof(magic)) != 0 || header[1] != version
+        || (size_t) st.st_size != headerSize + sizeof(uint64_t) * (n + 1 + m + m + n)) {
+        printf("%s is not a valid binary CSR file\n", fname);
+        munmap(data, st.st_size);
+        return -1;
+    }
+
+    unmap();
+    rowstart.clear(); adj.clear(); adjw.clear();
+    mapping = data;
+    mappingSize = st.st_size;
+
+    const uint64_t* body = header + 4;
+    rowstartView.data = (const size_t*) body; rowstartView.n = n + 1;
+    adjView.data = (const size_t*) (body + n + 1); adjView.n = m;
+    adjwView.data = (const double*) (body + n + 1 + m); adjwView.n = m;
+    const size_t* weights = (const size_t*) (body + n + 1 + 2*m);
+    vtxw.assign(weights, weights + n);
+
+    *nVtx = n;
+    *nEdges = m;
+    return 0;
+}
+
+// Pages of adj and adjw holding the edges [begin, end), only those entirely within when inner is set
+void CSR::advise(size_t begin, size_t end, int advice, bool inner) const {
+    if (!mapping || begin >= end) return;
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    const char* base = (const char*) mapping;
+    const char* ranges[2][2] = {
+        {(const char*) (adjView.data + begin), (const char*) (adjView.data + end)},
+        {(const char*) (adjwView.data + begin), (const char*) (adjwView.data + end)}
+    };
+    for (const auto& range : ranges){
+        const size_t first = (range[0] - base + (inner ? page - 1 : 0)) / page * page;
+        const size_t last = std::min(mappingSize, (range[1] - base + (inner ? 0 : page - 1)) / page * page);
+        if (first < last) madvise((char*) base + first, last - first, advice);
+    }
+}
+
+void CSR::prefetch(size_t begin, size_t end) const {
+    advise(begin, end, MADV_WILLNEED, false);
+}
+
+// The mapping is read only : released pages are read again from the file when needed. The pages
+// shared with the neighbouring edges are kept, the next block may already have prefetched them.
+void CSR::release(size_t begin, size_t end) const {
+    advise(begin, end, MADV_DONTNEED, true);
+}
+
+bool isBinaryCSR(const char* fname){
+    FILE* fh = fopen(fname, "rb");
+    if (fh == NULL) return false;
+    char start[sizeof(magic)];
+    const bool binary = fread(start, 1, sizeof(start), fh) == sizeof(start) && memcmp(start, magic, sizeof(magic)) == 0;
+    fclose(fh);
+    return binary;
+}
+
+size_t writeCSRHeader(FILE* fh, size_t nVtx, size_t nEdges){
+    const uint64_t header[3] = {version, nVtx, nEdges};
+    if (fwrite(magic, 1, sizeof(magic), fh) != sizeof(magic) || fwrite(header, sizeof(uint64_t), 3, fh) != 3) return 0;
+    return headerSize;
+}
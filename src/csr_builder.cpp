@@ -0,0 +1,370 @@
+#include "headers/csr_builder.hpp"
+#include "headers/csr.hpp"
+#include "headers/io.hpp"
+#include "headers/thread_pool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <queue>
+#include <stdio.h>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+// Sequential writes to the arrays of a binary CSR file, each array through its own handle
+struct CSRWriter {
+    FILE* rowstartFile = NULL;
+    FILE* adjFile = NULL;
+    FILE* adjwFile = NULL;
+    FILE* vtxwFile = NULL;
+    size_t adjwOffset = 0;
+    bool good = false;
+
+    CSRWriter(const char* fname, size_t nVtx, size_t nEdges){
+        FILE* fh = fopen(fname, "wb");
+        if (fh == NULL) return;
+        const size_t header = writeCSRHeader(fh, nVtx, nEdges);
+        if (fclose(fh) != 0 || header == 0) return;
+
+        const size_t offsets[4] = {header, header + sizeof(uint64_t) * (nVtx + 1),
+                                   header + sizeof(uint64_t) * (nVtx + 1 + nEdges),
+                                   header + sizeof(uint64_t) * (nVtx + 1 + 2*nEdges)};
+        FILE** files[4] = {&rowstartFile, &adjFile, &adjwFile, &vtxwFile};
+        good = true;
+        for (size_t k = 0; k < 4; k++){
+            *files[k] = fopen(fname, "r+b");
+            good = good && *files[k] != NULL && fseek(*files[k], offsets[k], SEEK_SET) == 0;
+        }
+        adjwOffset = offsets[2];
+    }
+
+    void rowstart(uint64_t start){ good = good && fwrite(&start, sizeof(start), 1, rowstartFile) == 1; }
+    void edge(uint64_t neig, double w){
+        good = good && fwrite(&neig, sizeof(neig), 1, adjFile) == 1;
+        good = good && fwrite(&w, sizeof(w), 1, adjwFile) == 1;
+    }
+    void vertex(uint64_t w){ good = good && fwrite(&w, sizeof(w), 1, vtxwFile) == 1; }
+
+    // Returns true if everything was written
+    bool close(){
+        FILE* files[4] = {rowstartFile, adjFile, adjwFile, vtxwFile};
+        for (FILE* fh : files) if (fh != NULL && fclose(fh) != 0) good = false;
+        rowstartFile = adjFile = adjwFile = vtxwFile = NULL;
+        return good;
+    }
+};
+
+// Divide the nEdges weights starting at offset by max_w, by chunks
+static bool normalizeWeights(const char* fname, size_t offset, size_t nEdges, double max_w){
+    if (max_w <= 0.0 || max_w == 1.0) return true;
+    FILE* fh = fopen(fname, "r+b");
+    if (fh == NULL) return false;
+
+    bool ok = true;
+    std::vector<double> chunk;
+    for (size_t begin = 0; ok && begin < nEdges; begin += chunk.size()){
+        chunk.resize(std::min(nEdges - begin, (size_t) 1 << 16));
+        ok = fseek(fh, offset + sizeof(double) * begin, SEEK_SET) == 0
+          && fread(chunk.data(), sizeof(double), chunk.size(), fh) == chunk.size();
+        for (double& w : chunk) w /= max_w;
+        ok = ok && fseek(fh, offset + sizeof(double) * begin, SEEK_SET) == 0
+          && fwrite(chunk.data(), sizeof(double), chunk.size(), fh) == chunk.size();
+    }
+    if (fclose(fh) != 0) ok = false;
+    return ok;
+}
+
+int CSRBuilder::fromAdjacency(const char* fgraph, const char* fcsr) const {
+    FILE* fh = fopen(fgraph, "r");
+    if (fh == NULL) {
+        printf("File : %s couldn't be opened\n", fgraph);
+        return -1;
+    }
+
+    char* line = NULL;
+    size_t capacity = 0;
+    size_t nVtx = 0, nEdges = 0;
+    int weightType = 0;
+    if (getline(&line, &capacity, fh) < 0 || sscanf(line, "%zu %zu %d", &nVtx, &nEdges, &weightType) != 3
+        || (weightType != UNWEIGHTED && weightType != EDGE_WEIGHTED && weightType != NODE_WEIGHTED && weightType != EDGE_NODE_WEIGHTED)) {
+        printf("%s doesn't start with a valid header\n", fgraph);
+        free(line);
+        fclose(fh);
+        return -1;
+    }
+    nEdges *= 2; // Edges are put twice
+    const bool nodeWeighted = weightType == NODE_WEIGHTED || weightType == EDGE_NODE_WEIGHTED;
+    const bool edgeWeighted = weightType == EDGE_WEIGHTED || weightType == EDGE_NODE_WEIGHTED;
+
+    CSRWriter writer(fcsr, nVtx, nEdges);
+    size_t currVtx = 0, currEdge = 0;
+    double max_w = 0.0;
+    bool valid = true;
+    writer.rowstart(0);
+    while (valid && writer.good && currVtx < nVtx && getline(&line, &capacity, fh) >= 0) {
+        char* p = line;
+        char* end;
+        uint64_t vw = 1;
+        if (nodeWeighted) {
+            vw = strtoull(p, &end, 10);
+            if (end == p) vw = 1;
+            p = end;
+        }
+        while (true) {
+            const uint64_t neig = strtoull(p, &end, 10);
+            if (end == p) break;
+            p = end;
+            double w = 1.0;
+            if (edgeWeighted) {
+                w = strtod(p, &end);
+                valid = valid && end != p;
+                p = end;
+            }
+            valid = valid && neig >= 1 && neig <= nVtx && currEdge < nEdges;
+            if (!valid) break;
+            writer.edge(neig - 1, w);
+            max_w = std::max(max_w, w);
+            currEdge++;
+        }
+        writer.vertex(vw);
+        writer.rowstart(currEdge);
+        currVtx++;
+    }
+    free(line);
+    fclose(fh);
+
+    bool ok = writer.close();
+    if (!ok) printf("File : %s couldn't be written\n", fcsr);
+    else if (!valid) printf("%s : bad line for vertex %zu\n", fgraph, currVtx);
+    else if (currVtx != nVtx || currEdge != nEdges) {
+        printf("%s announces %zu vertices and %zu edges but has %zu and %zu\n", fgraph, nVtx, nEdges / 2, currVtx, currEdge / 2);
+        valid = false;
+    }
+    ok = ok && valid && normalizeWeights(fcsr, writer.adjwOffset, nEdges, max_w);
+
+    if (!ok) {
+        remove(fcsr);
+        return -1;
+    }
+    if (verbose) printf("Wrote %s : %zu vertices, %zu edges\n", fcsr, nVtx, nEdges / 2);
+    return 0;
+}
+
+// Half edge of the edge list, runs are sorted by source then destination
+struct RunEntry {
+    uint64_t src, dst;
+    double w;
+
+    bool operator<(const RunEntry& other) const {
+        return src < other.src || (src == other.src && dst < other.dst);
+    }
+};
+
+// Buffered sequential reads of a sorted run
+struct RunReader {
+    FILE* fh = NULL;
+    std::vector<RunEntry> buffer;
+    size_t next = 0, size = 0;
+
+    bool pop(RunEntry& e){
+        if (next == size) {
+            size = fread(buffer.data(), sizeof(RunEntry), buffer.size(), fh);
+            next = 0;
+            if (size == 0) return false;
+        }
+        e = buffer[next++];
+        return true;
+    }
+};
+
+// Merge the sorted runs in files, each read through bufferEntries entries, calling emit on every
+// entry in order. Equal entries come in the order of their runs. Returns false on a read error
+// or once emit returned false.
+template <typename Emit>
+static bool mergeRuns(const std::vector<std::string>& files, size_t bufferEntries, Emit emit){
+    std::vector<RunReader> runs(files.size());
+    bool ok = true;
+    for (size_t r = 0; r < runs.size(); r++){
+        runs[r].fh = fopen(files[r].c_str(), "rb");
+        runs[r].buffer.resize(bufferEntries);
+        ok = ok && runs[r].fh != NULL;
+    }
+
+    if (ok) {
+        typedef std::pair<RunEntry, size_t> Head;
+        auto later = [](const Head& a, const Head& b){ return b.first < a.first || (!(a.first < b.first) && a.second > b.second); };
+        std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+        for (size_t r = 0; r < runs.size(); r++){
+            RunEntry e;
+            if (runs[r].pop(e)) heads.push(Head(e, r));
+        }
+        while (!heads.empty() && ok) {
+            const Head head = heads.top();
+            heads.pop();
+            ok = emit(head.first);
+            RunEntry e;
+            if (runs[head.second].pop(e)) heads.push(Head(e, head.second));
+        }
+    }
+
+    for (RunReader& run : runs) if (run.fh != NULL) fclose(run.fh);
+    return ok;
+}
+
+int CSRBuilder::fromEdgeList(const char* fedges, const char* fcsr) const {
+    FILE* fh = fopen(fedges, "r");
+    if (fh == NULL) {
+        printf("File : %s couldn't be opened\n", fedges);
+        return -1;
+    }
+
+    // Each batch reads one text chunk per thread, then the chunks are parsed, sorted
+    // and written as runs in parallel. A line takes about two entries and its text.
+    const size_t n_parallel = threadPool().size();
+    const size_t linesPerRun = std::max((size_t) 1 << 12, memoryLimit / (n_parallel * (2 * sizeof(RunEntry) + 16)));
+    const std::string runPrefix = std::string(fcsr) + ".run";
+
+    std::vector<std::string> texts(n_parallel);
+    std::vector<size_t> runCount(n_parallel), runMaxVertex(n_parallel);
+    std::vector<double> runMaxWeight(n_parallel);
+    std::vector<char> runValid(n_parallel);
+    size_t n_runs = 0, nEdges = 0, nVtx = 0;
+    double max_w = 0.0;
+    bool ok = true, eof = false;
+    char* line = NULL;
+    size_t capacity = 0;
+    while (ok && !eof) {
+        size_t batch = 0;
+        for (; batch < n_parallel && !eof; batch++){
+            texts[batch].clear();
+            for (size_t l = 0; l < linesPerRun; l++){
+                const ssize_t len = getline(&line, &capacity, fh);
+                if (len < 0) { eof = true; break; }
+                texts[batch].append(line, len);
+                if (line[len-1] != '\n') texts[batch].push_back('\n');
+            }
+        }
+
+        threadPool().run(batch, [&](size_t k){
+            std::vector<RunEntry> entries;
+            size_t maxVertex = 0;
+            double maxWeight = 0.0;
+            bool valid = true;
+            char* text = &texts[k][0];
+            for (char* p = text; valid && p < text + texts[k].size();){
+                char* eol = std::find(p, text + texts[k].size(), '\n');
+                *eol = '\0';
+                while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+                if (*p != '\0' && *p != '#' && *p != '%') {
+                    const char* start = p;
+                    char* end;
+                    const uint64_t src = strtoull(p, &end, 10);
+                    valid = end != p;
+                    p = end;
+                    const uint64_t dst = strtoull(p, &end, 10);
+                    valid = valid && end != p;
+                    p = end;
+                    double w = strtod(p, &end);
+                    if (end == p) w = 1.0;
+                    if (!valid) {
+                        printf("%s : bad line '%s'\n", fedges, start);
+                        break;
+                    }
+                    if (src == 0 || dst == 0) {
+                        printf("%s : vertex 0 in line '%s', vertices are numbered from 1\n", fedges, start);
+                        valid = false;
+                        break;
+                    }
+                    entries.push_back(RunEntry{src - 1, dst - 1, w});
+                    entries.push_back(RunEntry{dst - 1, src - 1, w});
+                    maxVertex = std::max(maxVertex, (size_t) std::max(src, dst));
+                    maxWeight = std::max(maxWeight, w);
+                }
+                p = eol + 1;
+            }
+            std::string().swap(texts[k]);
+            std::sort(entries.begin(), entries.end());
+
+            const std::string fname = runPrefix + std::to_string(n_runs + k);
+            FILE* run = fopen(fname.c_str(), "wb");
+            valid = valid && run != NULL && fwrite(entries.data(), sizeof(RunEntry), entries.size(), run) == entries.size();
+            if (run != NULL && fclose(run) != 0) valid = false;
+
+            runCount[k] = entries.size();
+            runMaxVertex[k] = maxVertex;
+            runMaxWeight[k] = maxWeight;
+            runValid[k] = valid;
+        });
+
+        for (size_t k = 0; k < batch; k++){
+            ok = ok && runValid[k];
+            nEdges += runCount[k];
+            nVtx = std::max(nVtx, runMaxVertex[k]);
+            max_w = std::max(max_w, runMaxWeight[k]);
+        }
+        n_runs += batch;
+    }
+    free(line);
+    fclose(fh);
+    if (max_w <= 0.0) max_w = 1.0;
+
+    // The runs are merged by groups of at most maxFanIn into longer runs until one pass can merge
+    // them all, fewer when the open files are limited. The memory is shared by the buffers of the
+    // runs read and of the run written.
+    std::vector<std::string> runFiles(n_runs);
+    for (size_t r = 0; r < n_runs; r++) runFiles[r] = runPrefix + std::to_string(r);
+    size_t fanIn = maxFanIn;
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY)
+        fanIn = std::max((size_t) 2, std::min(fanIn, (size_t) files.rlim_cur - std::min((size_t) files.rlim_cur, reservedFiles)));
+    const size_t bufferEntries = std::max((size_t) 64, memoryLimit / ((fanIn + 1) * sizeof(RunEntry)));
+    size_t n_merged = 0;
+    while (ok && runFiles.size() > fanIn) {
+        std::vector<std::string> merged;
+        for (size_t begin = 0; ok && begin < runFiles.size(); begin += fanIn){
+            const std::vector<std::string> group(runFiles.begin() + begin, runFiles.begin() + std::min(begin + fanIn, runFiles.size()));
+            merged.push_back(runPrefix + std::to_string(n_runs + n_merged++));
+            FILE* out = fopen(merged.back().c_str(), "wb");
+            std::vector<RunEntry> buffer;
+            buffer.reserve(bufferEntries);
+            auto flush = [&](){
+                const bool written = fwrite(buffer.data(), sizeof(RunEntry), buffer.size(), out) == buffer.size();
+                buffer.clear();
+                return written;
+            };
+            ok = out != NULL && mergeRuns(group, bufferEntries, [&](const RunEntry& e){
+                buffer.push_back(e);
+                return buffer.size() < bufferEntries || flush();
+            });
+            ok = ok && flush();
+            if (out != NULL && fclose(out) != 0) ok = false;
+            for (const std::string& fname : group) remove(fname.c_str());
+        }
+        // The runs not merged yet after an error are removed below with the merged ones
+        for (size_t r = merged.size() * fanIn; r < runFiles.size(); r++) merged.push_back(runFiles[r]);
+        runFiles.swap(merged);
+    }
+
+    if (ok) {
+        CSRWriter writer(fcsr, nVtx, nEdges);
+        size_t row = 0, count = 0;
+        ok = mergeRuns(runFiles, bufferEntries, [&](const RunEntry& e){
+            for (; row <= e.src; row++) writer.rowstart(count);
+            writer.edge(e.dst, e.w / max_w);
+            count++;
+            return writer.good;
+        });
+        for (; row <= nVtx; row++) writer.rowstart(count);
+        for (size_t i = 0; i < nVtx; i++) writer.vertex(1);
+        ok = writer.close() && ok && count == nEdges;
+    }
+
+    for (const std::string& fname : runFiles) remove(fname.c_str());
+    if (!ok) {
+        printf("%s couldn't be converted\n", fedges);
+        remove(fcsr);
+        return -1;
+    }
+    if (verbose) printf("Wrote %s : %zu vertices, %zu edges, merged from %zu sorted runs\n", fcsr, nVtx, nEdges / 2, n_runs);
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include "headers/forceatlas2.hpp"
+#include "headers/graph.hpp"
+#include "headers/thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+void ForceAtlas2::init(const Graph& g){
+    const size_t n = g.n_vtx;
+    mass.resize(n);
+    for (size_t i = 0; i < n; i++) mass[i] = (float) (g.rowstart[i+1] - g.rowstart[i]) + 1.0f;
+
+    force.assign(2*n, 0.0f);
+    oldForce.assign(2*n, 0.0f);
+    speed = 1.0f;
+    speedEfficiency = 1.0f;
+}
+
+// Global speed controller (see section "Adaptive speed" of the ForceAtlas2 paper)
+void ForceAtlas2::adjustSpeed(double globalSwing, double globalTraction, size_t n){
+    if (globalSwing <= 0.0 || globalTraction <= 0.0) return;
+
+    // Jitter tolerance is estimated from the size of the graph
+    const double estimatedOptimalJT = 0.05 * std::sqrt((double) n);
+    const double minJT = std::sqrt(estimatedOptimalJT);
+    const double maxJT = 10.0;
+    double jt = tolerance * std::max(minJT, std::min(maxJT, estimatedOptimalJT * globalTraction / ((double) n * n)));
+
+    const double minSpeedEfficiency = 0.05;
+
+    // Protection against erratic behaviour
+    if (globalSwing / globalTraction > 2.0){
+        if (speedEfficiency > minSpeedEfficiency) speedEfficiency *= 0.5f;
+        jt = std::max(jt, (double) tolerance);
+    }
+
+    const double targetSpeed = jt * speedEfficiency * globalTraction / globalSwing;
+
+    // Speed efficiency is how much we trust the target speed
+    if (globalSwing > jt * globalTraction){
+        if (speedEfficiency > minSpeedEfficiency) speedEfficiency *= 0.7f;
+    } else if (speed < 1000.0f) {
+        speedEfficiency *= 1.3f;
+    }
+
+    // The speed shouldn't rise too much too quickly
+    const double maxRise = 0.5;
+    speed = speed + std::min(targetSpeed - speed, maxRise * speed);
+}
+
+void ForceAtlas2::step(const Graph& g, float* pos){
+    const size_t n = g.n_vtx;
+    if (mass.size() != n) init(g);
+
+    // Only the awake vertices are moved, asleep ones keep their last forces
+    for (const size_t i : g.active){
+        oldForce[2*i] = force[2*i];
+        oldForce[2*i+1] = force[2*i+1];
+        force[2*i] = 0.0f;
+        force[2*i+1] = 0.0f;
+    }
+
+    // Gravity force : Pull back every node towards the center of the canvas, proportionally to its mass
+    threadPool().parallel_for(g.active.size(), [&](size_t begin, size_t end){
+        for (size_t a = begin; a < end; a++){
+            const size_t i = g.active[a];
+            const float px = pos[2*i];
+            const float py = pos[2*i+1];
+            const float dist = std::hypot(px, py);
+            if (dist <= 0.0f) continue;
+
+            // Strong gravity does not decrease with the distance
+            const float f = strongGravity ? gravity * mass[i] : gravity * mass[i] / dist;
+            force[2*i]   -= px * f;
+            force[2*i+1] -= py * f;
+        }
+    });
+
+    // Repulsion force : kr * (deg_i+1) * (deg_j+1) / dist
+    const size_t n_active = g.active.size();
+    if (g.theta > 0.0f) {
+        // Barnes-Hut : every awake vertex is pushed by the whole tree, asleep vertices included
+        tree.update(pos, &mass[0], n);
+        std::vector<float> repulsion(2*n);
+        tree.repulsion(pos, &mass[0], &g.asleep[0], g.theta, &repulsion[0]);
+        for (const size_t i : g.active){
+            force[2*i]   += scaling * mass[i] * repulsion[2*i];
+            force[2*i+1] += scaling * mass[i] * repulsion[2*i+1];
+        }
+    } else {
+        g.pairwise(&force[0], [&](size_t i, size_t j, float& fx, float& fy){
+            const float vx = pos[2*i] - pos[2*j];
+            const float vy = pos[2*i+1] - pos[2*j+1];
+            const float dist2 = vx*vx + vy*vy;
+            const float f = dist2 > 0.0f ? scaling * mass[i] * mass[j] / dist2 : 0.0f;
+            fx = vx*f;
+            fy = vy*f;
+        });
+    }
+
+    // Attraction force : each edge is stored twice in the CSR, so each endpoint only pulls itself
+    float attractionCoef = 1.0f;
+    if (dissuadeHubs) {
+        // Keep the same overall attraction as without dissuasion of hubs
+        double totalMass = 0.0;
+        for (size_t i = 0; i < n; i++) totalMass += mass[i];
+        attractionCoef = (float) (totalMass / n);
+    }
+    threadPool().parallel_for(g.active.size(), [&](size_t begin, size_t end){
+        for (size_t a = begin; a < end; a++){
+            const size_t i = g.active[a];
+            const float ix = pos[2*i];
+            const float iy = pos[2*i+1];
+            const float icoef = dissuadeHubs ? attractionCoef / mass[i] : attractionCoef;
+            for (size_t j = g.rowstart[i]; j < g.rowstart[i+1]; j++){
+                const size_t neig = g.adj[j];
+                if (neig == i) continue;
+
+                float w = (float) g.adjw[j];
+                if (edgeWeightInfluence == 0.0f) w = 1.0f;
+                else if (edgeWeightInfluence != 1.0f) w = std::pow(w, edgeWeightInfluence);
+
+                // Direction from i to neig
+                const float vx = pos[2*neig] - ix;
+                const float vy = pos[2*neig+1] - iy;
+                float f = icoef * w;
+                if (linlog) {
+                    const float dist = std::hypot(vx, vy);
+                    if (dist <= 0.0f) continue;
+                    f *= std::log1p(dist) / dist;
+                }
+                force[2*i]   += vx*f;
+                force[2*i+1] += vy*f;
+            }
+        }
+    });
+
+    // Swinging : divergence between two consecutive forces (oscillation)
+    // Traction : the force that actually moves the vertex
+    // Partial sums of fixed blocks are added in order whatever the number of threads
+    const size_t blockSize = 4096;
+    const size_t n_blocks = (n_active + blockSize - 1) / blockSize;
+    std::vector<double> blockSwing(n_blocks), blockTraction(n_blocks);
+    threadPool().blocks(n_active, blockSize, [&](size_t b, size_t begin, size_t end){
+        double swing = 0.0, traction = 0.0;
+        for (size_t a = begin; a < end; a++){
+            const size_t i = g.active[a];
+            const float sx = force[2*i] - oldForce[2*i];
+            const float sy = force[2*i+1] - oldForce[2*i+1];
+            const float tx = force[2*i] + oldForce[2*i];
+            const float ty = force[2*i+1] + oldForce[2*i+1];
+            swing    += mass[i] * std::hypot(sx, sy);
+            traction += 0.5 * mass[i] * std::hypot(tx, ty);
+        }
+        blockSwing[b] = swing;
+        blockTraction[b] = traction;
+    });
+    double globalSwing = 0.0, globalTraction = 0.0;
+    for (size_t b = 0; b < n_blocks; b++){
+        globalSwing += blockSwing[b];
+        globalTraction += blockTraction[b];
+    }
+    adjustSpeed(globalSwing, globalTraction, n_active);
+
+    // Apply forces : each vertex slows down proportionally to its own swinging
+    threadPool().parallel_for(g.active.size(), [&](size_t begin, size_t end){
+        for (size_t a = begin; a < end; a++){
+            const size_t i = g.active[a];
+            const float sx = force[2*i] - oldForce[2*i];
+            const float sy = force[2*i+1] - oldForce[2*i+1];
+            const float swing = mass[i] * std::hypot(sx, sy);
+            const float factor = speed / (1.0f + std::sqrt(speed * swing));
+            pos[2*i]   += force[2*i] * factor;
+            pos[2*i+1] += force[2*i+1] * factor;
+        }
+    });
+}
@@ -0,0 +1,19 @@
+#include "headers/forces.hpp"
+#include <memory>
+#include <tuple>
+
+// Same constants as the original model : gravity 0.1, repulsion 0.1, and an attraction of
+// 2 Fa with Fa = 2 since each edge is stored twice in the CSR and pulls both of its endpoints
+template <typename Repulsion>
+static std::unique_ptr<ForceModel> defaultModel(){
+    Layout<Gravity, Repulsion, Attraction>* layout = new Layout<Gravity, Repulsion, Attraction>();
+    std::get<Gravity>(layout->terms).strength = 0.1f;
+    std::get<Repulsion>(layout->terms).strength = 0.1f;
+    std::get<Attraction>(layout->terms).strength = 4.0f;
+    return std::unique_ptr<ForceModel>(layout);
+}
+
+std::unique_ptr<ForceModel> defaultForceModel(const Graph& g){
+    if (g.theta > 0.0f) return defaultModel<BarnesHutRepulsion>();
+    return defaultModel<ExactRepulsion>();
+}
@@ -1,8 +1,11 @@
 #include "headers/graph.hpp"
 #include <algorithm>
+#include <climits>
 #include <cmath>
+#include <cstdlib>
 #include <exception>
 #include <fstream>
+#include <random>
 #include <sstream>
 #include <stdio.h>
 #include <cstddef>
@@ -12,10 +15,21 @@
 #include <GLFW/glfw3.h>
 
 #include "headers/io.hpp"
+#include "headers/components.hpp"
+#include "headers/forces.hpp"
+#include "headers/thread_pool.hpp"
 
 void Graph::read_edgelist_file(const char* fname){
 
-    readFile(fname, &n_vtx, &n_edges, rowstart, adj, vtxw, adjw);
+    // A binary CSR is mapped as is, its weights are already normalized
+    const bool binary = isBinaryCSR(fname);
+    if (binary) {
+        if (csr->map(fname, &n_vtx, &n_edges, vtxw) != 0) exit(EXIT_FAILURE);
+        printf("Mapped binary CSR : %zu vertices, %zu edges\n", n_vtx, n_edges / 2);
+    } else {
+        readFile(fname, &n_vtx, &n_edges, csr->rowstart, csr->adj, vtxw, csr->adjw);
+        csr->bind();
+    }
 
     double max_w = 0.0;
     wDeg.resize(n_vtx);
@@ -34,15 +48,11 @@ void Graph::read_edgelist_file(const char* fname){
     float max_wdeg = 0.0f;
     for (size_t i = 0; i < n_vtx; i++) max_wdeg = std::max(max_wdeg, wDeg[i]);
 
-    for (size_t i = 0; i < n_edges; i++) adjw[i] /= max_w; // Normalize the weights
+    if (!binary) for (size_t i = 0; i < n_edges; i++) csr->adjw[i] /= max_w; // Normalize the weights
     for (size_t i = 0; i < n_vtx; i++) wDeg[i] /= 2.0f * max_wdeg;
 
-    pos.reserve(2*n_vtx);
-    colors.reserve(3*n_vtx);
-    for (size_t i = 0; i < n_vtx; i++){
-        pos[2*i] = -1.0f + 2.0f*static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-        pos[2*i+1] = -1.0f + 2.0f*static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-    }
+    pos.resize(2*n_vtx);
+    randomLayout(*this, &pos[0], stress.seed);
 }
 
 void Graph::read_partition_file(const char* fname){
@@ -72,70 +82,468 @@ void Graph::read_partition_file(const char* fname){
     curr_hierarchy = n_hierarchy - 1;
 }
 
-Graph::Graph(const char * fedges, const char * fpart){
+void Graph::bfs(size_t source, std::vector<int>& dist) const {
+    dist.assign(n_vtx, -1);
+    std::vector<size_t> queue;
+    queue.reserve(n_vtx);
+
+    dist[source] = 0;
+    queue.push_back(source);
+    for (size_t head = 0; head < queue.size(); head++){
+        const size_t i = queue[head];
+        for (size_t j = rowstart[i]; j < rowstart[i+1]; j++){
+            const size_t neig = adj[j];
+            if (dist[neig] >= 0) continue;
+            dist[neig] = dist[i] + 1;
+            queue.push_back(neig);
+        }
+    }
+}
+
+// Unreachable vertices are chosen first so that every connected component
+// gets a pivot when possible
+void Graph::pivotDistances(size_t k, unsigned int seed, std::vector<size_t>& pivots, std::vector<std::vector<int>>& dist) const {
+    k = std::min(k, n_vtx);
+    pivots.resize(k);
+    dist.resize(k);
+    if (k == 0) return;
+
+    std::vector<int> minDist(n_vtx, INT_MAX);
+    std::mt19937 rng(seed);
+    pivots[0] = rng() % n_vtx;
+    for (size_t p = 0; p < k; p++){
+        bfs(pivots[p], dist[p]);
+        for (size_t i = 0; i < n_vtx; i++){
+            if (dist[p][i] >= 0) minDist[i] = std::min(minDist[i], dist[p][i]);
+        }
+        if (p + 1 < k) pivots[p+1] = std::max_element(minDist.begin(), minDist.end()) - minDist.begin();
+    }
+}
+
+Graph::Graph(const char * fedges, const char * fpart)
+    : csr(std::make_shared<CSR>()), rowstart(csr->rowstartView), adj(csr->adjView), adjw(csr->adjwView) {
     read_edgelist_file(fedges);
-    read_partition_file(fpart);
+    if (fpart != NULL) read_partition_file(fpart);
+    wake();
 }
 
-void Graph::step(){
-    //  Attraction - repulsion - gravity model 
-    float *dp = new float[2*n_vtx];
-    for (size_t i = 0; i < 2*n_vtx; i++) dp[i] = 0.0f;
-    const float dt = 1.0f/20.0f;
+Graph::Graph(const Graph& parent, const std::vector<size_t>& vertices, const std::vector<size_t>& localIndex)
+    : csr(std::make_shared<CSR>()), rowstart(csr->rowstartView), adj(csr->adjView), adjw(csr->adjwView) {
+    n_vtx = vertices.size();
 
-    // Gravity force : Pull back every node towards the center of the canvas 
-    const float Fg = 0.1f;
+    csr->rowstart.resize(n_vtx + 1);
+    wDeg.resize(n_vtx);
+    vtxw.resize(n_vtx);
+    pos.resize(2*n_vtx);
+    csr->rowstart[0] = 0;
     for (size_t i = 0; i < n_vtx; i++){
-        const float px = pos[2*i];
-        const float py = pos[2*i+1];
-        const float norm = std::hypot(px, py);
-        dp[2*i]   -= px / norm * Fg;
-        dp[2*i+1] -= py / norm * Fg;
-    }
-
-    // Repulsion force : simply use the reverse of the distance between nodes
-    const float Fr = 0.10f;
-    // const float Fr = 0.15f;
-
-    for (size_t i = 0; i < n_vtx-1; i++){
-        const float ix = pos[2*i];
-        const float iy = pos[2*i+1];
-        for (size_t j = i+1; j < n_vtx; j++){
-            const float jx = pos[2*j];
-            const float jy = pos[2*j+1];
-            // Direction from j to i
-            const float vx = ix-jx;
-            const float vy = iy-jy;
-            const float dist = vx*vx + vy*vy; 
-
-            dp[2*i] += Fr*vx/dist; dp[2*j] -= Fr*vx/dist;
-            dp[2*i+1] += Fr*vy/dist; dp[2*j+1] -= Fr*vy/dist;
+        const size_t v = vertices[i];
+        for (size_t j = parent.rowstart[v]; j < parent.rowstart[v+1]; j++){
+            // Only the edges inside the subgraph
+            const size_t local = localIndex[parent.adj[j]];
+            if (local >= n_vtx || vertices[local] != parent.adj[j]) continue;
+            csr->adj.push_back(local);
+            csr->adjw.push_back(parent.adjw[j]);
         }
+        csr->rowstart[i+1] = csr->adj.size();
+        wDeg[i] = parent.wDeg[v];
+        vtxw[i] = parent.vtxw[v];
+        pos[2*i] = parent.pos[2*v];
+        pos[2*i+1] = parent.pos[2*v+1];
     }
+    csr->bind();
+    n_edges = adj.size();
+
+    copyParameters(parent);
+    wake();
+}
+
+Graph::Graph(const Graph& parent, initType init, unsigned int seed)
+    : csr(parent.csr), rowstart(csr->rowstartView), adj(csr->adjView), adjw(csr->adjwView) {
+    n_vtx = parent.n_vtx;
+    n_edges = parent.n_edges;
+    wDeg = parent.wDeg;
+    vtxw = parent.vtxw;
+    pos.resize(2*n_vtx);
+    copyParameters(parent);
+    stress.seed = seed;
+    verbose = false;
+    initialLayout(init, seed);
+}
+
+Graph::~Graph() {}
+
+void Graph::copyParameters(const Graph& parent){
+    layout = parent.layout;
+    fa2.scaling = parent.fa2.scaling;
+    fa2.gravity = parent.fa2.gravity;
+    fa2.edgeWeightInfluence = parent.fa2.edgeWeightInfluence;
+    fa2.tolerance = parent.fa2.tolerance;
+    fa2.linlog = parent.fa2.linlog;
+    fa2.dissuadeHubs = parent.fa2.dissuadeHubs;
+    fa2.strongGravity = parent.fa2.strongGravity;
+    stress.pivots = parent.stress.pivots;
+    stress.maxExactVertices = parent.stress.maxExactVertices;
+    stress.epochs = parent.stress.epochs;
+    stress.epsilon = parent.stress.epsilon;
+    stress.seed = parent.stress.seed;
+    sleeping = parent.sleeping;
+    theta = parent.theta;
+    momentum = parent.momentum;
+    damping = parent.damping;
+    minTimeStep = parent.minTimeStep;
+    maxTimeStep = parent.maxTimeStep;
+    maxMove = parent.maxMove;
+    sleepEpsilon = parent.sleepEpsilon;
+    wakeEpsilon = parent.wakeEpsilon;
+    sleepSteps = parent.sleepSteps;
+    convergence.threshold = parent.convergence.threshold;
+    convergence.window = parent.convergence.window;
+}
+
+void Graph::addEdges(const std::vector<Edge>& edges){
+    if (edges.empty()) return;
 
-    // Attraction forces : Vertices linked to each other attract themselves
-    //const float Fa = 0.05f;
-    const float Fa = 2.00;
+    std::vector<size_t> count(n_vtx, 0);
+    for (const Edge& e : edges) { count[e.src]++; count[e.dest]++; }
+
+    std::vector<size_t> newRowstart(n_vtx + 1);
+    newRowstart[0] = 0;
+    for (size_t i = 0; i < n_vtx; i++) newRowstart[i+1] = newRowstart[i] + rowstart[i+1] - rowstart[i] + count[i];
+
+    std::vector<size_t> newAdj(newRowstart[n_vtx]);
+    std::vector<double> newAdjw(newRowstart[n_vtx]);
     for (size_t i = 0; i < n_vtx; i++){
+        count[i] = newRowstart[i];
         for (size_t j = rowstart[i]; j < rowstart[i+1]; j++){
-            const size_t neig = adj[j];
-            const double neigw = adjw[j];
-            
-            const float ix = pos[2*i];
-            const float iy = pos[2*i+1];
-            const float neigx = pos[2*neig];
-            const float neigy = pos[2*neig+1];
-            // Direction from j to i
-            const float vx = ix-neigx;
-            const float vy = iy-neigy;
-            const float dist = std::hypot(vx, vy);
-
-            dp[2*i] -= Fa*neigw*vx/dist; dp[2*neig] += Fa*neigw*vx/dist;
-            dp[2*i+1] -= Fa*neigw*vy/dist; dp[2*neig+1] += Fa*neigw*vy/dist;
+            newAdj[count[i]] = adj[j];
+            newAdjw[count[i]++] = adjw[j];
+        }
+    }
+    for (const Edge& e : edges){
+        newAdj[count[e.src]] = e.dest; newAdjw[count[e.src]++] = e.w;
+        newAdj[count[e.dest]] = e.src; newAdjw[count[e.dest]++] = e.w;
+    }
+
+    csr->rowstart.swap(newRowstart);
+    csr->adj.swap(newAdj);
+    csr->adjw.swap(newAdjw);
+    csr->bind();
+    n_edges = adj.size();
+}
+
+void Graph::decompose(){
+    std::vector<size_t> component;
+    const size_t n_components = connectedComponents(*this, component);
+    printf("%zu connected components\n", n_components);
+    if (n_components < 2) return;
+
+    componentVertices.assign(n_components, std::vector<size_t>());
+    for (size_t i = 0; i < n_vtx; i++) componentVertices[component[i]].push_back(i);
+    std::stable_sort(componentVertices.begin(), componentVertices.end(),
+        [](const std::vector<size_t>& a, const std::vector<size_t>& b){ return a.size() > b.size(); });
+
+    std::vector<size_t> localIndex(n_vtx);
+    for (const std::vector<size_t>& vertices : componentVertices){
+        for (size_t i = 0; i < vertices.size(); i++) localIndex[vertices[i]] = i;
+    }
+
+    components.clear();
+    components.resize(n_components);
+    threadPool().run(n_components, [&](size_t c){
+        if (componentVertices[c].size() < 2) return;
+        components[c].reset(new Graph(*this, componentVertices[c], localIndex));
+        components[c]->verbose = false;
+    });
+
+    packComponents(true);
+    wake();
+}
+
+bool Graph::stepComponents(){
+    // A component holding most of the graph is stepped alone so that it can use every thread
+    size_t first = 0;
+    if (components[0] && 2 * components[0]->n_vtx >= n_vtx) {
+        components[0]->step();
+        first = 1;
+    }
+    threadPool().run(components.size() - first, [&](size_t c){
+        Graph* comp = components[first + c].get();
+        if (comp != nullptr) comp->step();
+    });
+
+    bool converged = true;
+    for (const std::unique_ptr<Graph>& comp : components){
+        if (comp && !comp->convergence.converged) converged = false;
+    }
+    packComponents(converged);
+    return converged;
+}
+
+// The components keep their slot while they fit in it, so that they don't jump from shelf to shelf
+// as the layout runs. They are packed again when one outgrows its slot, with some room to grow, and
+// tightly once they all converged.
+void Graph::packComponents(bool tight){
+    const size_t n_components = componentVertices.size();
+    std::vector<float> width(n_components), height(n_components), cx(n_components), cy(n_components);
+    for (size_t c = 0; c < n_components; c++){
+        const std::vector<size_t>& vertices = componentVertices[c];
+        float minx = 0.0f, maxx = 0.0f, miny = 0.0f, maxy = 0.0f;
+        if (components[c]) {
+            const std::vector<float>& p = components[c]->pos;
+            minx = maxx = p[0]; miny = maxy = p[1];
+            for (size_t i = 0; i < vertices.size(); i++){
+                minx = std::min(minx, p[2*i]); maxx = std::max(maxx, p[2*i]);
+                miny = std::min(miny, p[2*i+1]); maxy = std::max(maxy, p[2*i+1]);
+            }
+        }
+        cx[c] = 0.5f * (minx + maxx);
+        cy[c] = 0.5f * (miny + maxy);
+        const float margin = std::max(1.0f, 0.1f * std::max(maxx - minx, maxy - miny));
+        width[c] = maxx - minx + margin;
+        height[c] = maxy - miny + margin;
+    }
+
+    bool fits = !tight && slotX.size() == n_components;
+    for (size_t c = 0; fits && c < n_components; c++) fits = width[c] <= slotWidth[c] && height[c] <= slotHeight[c];
+    if (!fits) {
+        // Until then the slots only grow, a component that shrinks back keeps its room
+        if (tight || slotWidth.size() != n_components) {
+            slotWidth.assign(n_components, 0.0f);
+            slotHeight.assign(n_components, 0.0f);
         }
+        const float room = tight ? 1.0f : 1.25f;
+        for (size_t c = 0; c < n_components; c++){
+            slotWidth[c] = std::max(slotWidth[c], room * width[c]);
+            slotHeight[c] = std::max(slotHeight[c], room * height[c]);
+        }
+        packRectangles(slotWidth, slotHeight, slotX, slotY);
+    }
+    const std::vector<float>& x = slotX;
+    const std::vector<float>& y = slotY;
+
+    for (size_t c = 0; c < n_components; c++){
+        const std::vector<size_t>& vertices = componentVertices[c];
+        for (size_t i = 0; i < vertices.size(); i++){
+            const size_t v = vertices[i];
+            const float px = components[c] ? components[c]->pos[2*i] : cx[c];
+            const float py = components[c] ? components[c]->pos[2*i+1] : cy[c];
+            pos[2*v] = px - cx[c] + x[c];
+            pos[2*v+1] = py - cy[c] + y[c];
+        }
+    }
+}
+
+bool Convergence::update(float maxDisp, float kineticEnergy, size_t n, float extent){
+    maxDisplacement = maxDisp;
+    energy = kineticEnergy;
+    if (converged || n == 0) return false;
+
+    // A few vertices may keep jittering, so the largest displacement is only reported
+    const float rmsDisp = std::sqrt(kineticEnergy / n);
+    if (rmsDisp <= threshold * extent) stableSteps++;
+    else stableSteps = 0;
+
+    converged = stableSteps >= window;
+    return converged;
+}
+
+void Convergence::reset(){
+    stableSteps = 0;
+    converged = false;
+}
+
+void Graph::wake(){
+    convergence.reset();
+
+    asleep.assign(n_vtx, 0);
+    stillSteps.assign(n_vtx, 0);
+    velocity.assign(2*n_vtx, 0.0f);
+    timeStep = 0.05f;
+    forceEnergy = 0.0f;
+    inactive.clear();
+    active.resize(n_vtx);
+    for (size_t i = 0; i < n_vtx; i++) active[i] = i;
+
+    for (std::unique_ptr<Graph>& comp : components) if (comp) comp->wake();
+    if (core) core->wake();
+}
+
+void Graph::updateSleeping(float extent){
+    const float sleepDisp = sleepEpsilon * extent;
+    const float wakeDisp = wakeEpsilon * extent;
+
+    // Only the awake vertices moved during this step
+    for (const size_t i : active){
+        const float disp = std::hypot(pos[2*i] - prevPos[2*i], pos[2*i+1] - prevPos[2*i+1]);
+        if (disp > wakeDisp) {
+            // Moving significantly : wake up the neighbours
+            for (size_t j = rowstart[i]; j < rowstart[i+1]; j++){
+                const size_t neig = adj[j];
+                if (asleep[neig]) { asleep[neig] = 0; stillSteps[neig] = 0; }
+            }
+        }
+
+        if (disp < sleepDisp) {
+            if (++stillSteps[i] >= sleepSteps) {
+                asleep[i] = 1;
+                if (!velocity.empty()) velocity[2*i] = velocity[2*i+1] = 0.0f;
+            }
+        }
+        else stillSteps[i] = 0;
+    }
+
+    active.clear();
+    inactive.clear();
+    for (size_t i = 0; i < n_vtx; i++) {
+        if (asleep[i]) inactive.push_back(i);
+        else active.push_back(i);
+    }
+}
+
+void Graph::initialLayout(initType init, unsigned int seed){
+    switch (init) {
+        case INIT_RANDOM:
+            randomLayout(*this, &pos[0], seed);
+            break;
+        case INIT_SPECTRAL:
+            spectralLayout(*this, &pos[0], seed);
+            break;
+        case INIT_PIVOT_MDS:
+            pivotMDSLayout(*this, &pos[0], stress.pivots, seed);
+            break;
+        default:
+            return;
     }
+    wake();
+}
+
+void Graph::step(){
+    if (convergence.converged) return;
+
+    prevPos.assign(pos.begin(), pos.end());
+
+    // Stress SGD is done at the end of its annealing schedule, a decomposed
+    // graph once all of its components are, a pruned graph once its core is
+    bool finished = false;
+    if (core) {
+        core->step();
+        reattach();
+        finished = core->convergence.converged;
+    } else if (!components.empty()) {
+        finished = stepComponents();
+    } else {
+        switch (layout) {
+            case LAYOUT_FORCEATLAS2:
+                fa2.step(*this, &pos[0]);
+                break;
+            case LAYOUT_STRESS:
+                stress.step(*this, &pos[0]);
+                finished = stress.epoch >= stress.epochs;
+                break;
+            case LAYOUT_NONE:
+                break;
+            default:
+                stepDefault();
+        }
+    }
+    n_steps++;
+
+    // Track the displacement of the vertices during this step, the partial
+    // sums of fixed blocks are added in order whatever the number of threads
+    const size_t blockSize = 4096;
+    const size_t n_blocks = (n_vtx + blockSize - 1) / blockSize;
+    std::vector<float> blockEnergy(n_blocks), blockDisp2(n_blocks), blockBox(4*n_blocks);
+    threadPool().blocks(n_vtx, blockSize, [&](size_t b, size_t begin, size_t end){
+        float disp2 = 0.0f, e = 0.0f;
+        float bminx = pos[2*begin], bmaxx = pos[2*begin], bminy = pos[2*begin+1], bmaxy = pos[2*begin+1];
+        for (size_t i = begin; i < end; i++){
+            const float dx = pos[2*i] - prevPos[2*i];
+            const float dy = pos[2*i+1] - prevPos[2*i+1];
+            const float d2 = dx*dx + dy*dy;
+            disp2 = std::max(disp2, d2);
+            e += d2;
+            bminx = std::min(bminx, pos[2*i]); bmaxx = std::max(bmaxx, pos[2*i]);
+            bminy = std::min(bminy, pos[2*i+1]); bmaxy = std::max(bmaxy, pos[2*i+1]);
+        }
+        blockDisp2[b] = disp2;
+        blockEnergy[b] = e;
+        blockBox[4*b] = bminx; blockBox[4*b+1] = bmaxx; blockBox[4*b+2] = bminy; blockBox[4*b+3] = bmaxy;
+    });
+    float maxDisp2 = 0.0f, energy = 0.0f;
+    float minx = pos[0], maxx = pos[0], miny = pos[1], maxy = pos[1];
+    for (size_t b = 0; b < n_blocks; b++){
+        maxDisp2 = std::max(maxDisp2, blockDisp2[b]);
+        energy += blockEnergy[b];
+        minx = std::min(minx, blockBox[4*b]); maxx = std::max(maxx, blockBox[4*b+1]);
+        miny = std::min(miny, blockBox[4*b+2]); maxy = std::max(maxy, blockBox[4*b+3]);
+    }
+    const float extent = std::max(maxx - minx, maxy - miny);
+
+    if (sleeping && components.empty() && !core) updateSleeping(extent);
+
+    bool converged = convergence.update(std::sqrt(maxDisp2), energy, n_vtx, extent);
+    if (finished && !convergence.converged) convergence.converged = converged = true;
 
-    for (size_t i = 0; i < 2*n_vtx; i++) pos[i] += dt*dp[i];
-    delete [] dp;
-    return;
+    if (converged && verbose){
+        printf("Layout converged after %zu steps (max displacement %g, energy %g)\n",
+               n_steps, convergence.maxDisplacement, convergence.energy);
+    }
+}
+
+void Graph::stepDefault(){
+    if (!model) model = defaultForceModel(*this);
+    model->step(*this);
+}
+
+// The layout oscillates when the forces work against the velocities (as in FIRE, Bitzek et al. 2006) :
+// the velocities are then dropped and the time step halved
+void Graph::integrateMomentum(const float* force){
+    const size_t n_active = active.size();
+    if (velocity.size() != 2*n_vtx) velocity.assign(2*n_vtx, 0.0f);
+
+    // Power of the forces and energy, the partial sums of fixed blocks are added in order
+    const size_t blockSize = 4096;
+    const size_t n_blocks = (n_active + blockSize - 1) / blockSize;
+    std::vector<double> blockPower(n_blocks), blockEnergy(n_blocks);
+    threadPool().blocks(n_active, blockSize, [&](size_t b, size_t begin, size_t end){
+        double power = 0.0, e = 0.0;
+        for (size_t a = begin; a < end; a++){
+            const size_t i = active[a];
+            power += force[2*i] * velocity[2*i] + force[2*i+1] * velocity[2*i+1];
+            e += force[2*i] * force[2*i] + force[2*i+1] * force[2*i+1];
+        }
+        blockPower[b] = power;
+        blockEnergy[b] = e;
+    });
+    double power = 0.0, e = 0.0;
+    for (size_t b = 0; b < n_blocks; b++){
+        power += blockPower[b];
+        e += blockEnergy[b];
+    }
+
+    if (power < 0.0) {
+        for (const size_t i : active) velocity[2*i] = velocity[2*i+1] = 0.0f;
+        timeStep = std::max(minTimeStep, 0.5f * timeStep);
+    } else if (e < forceEnergy) {
+        timeStep = std::min(maxTimeStep, 1.1f * timeStep);
+    }
+    forceEnergy = (float) e;
+
+    threadPool().parallel_for(n_active, [&](size_t begin, size_t end){
+        for (size_t a = begin; a < end; a++){
+            const size_t i = active[a];
+            float vx = damping * velocity[2*i]   + timeStep * force[2*i];
+            float vy = damping * velocity[2*i+1] + timeStep * force[2*i+1];
+            const float move = timeStep * std::hypot(vx, vy);
+            if (move > maxMove) {
+                vx *= maxMove / move;
+                vy *= maxMove / move;
+            }
+            velocity[2*i] = vx;
+            velocity[2*i+1] = vy;
+            pos[2*i]   += timeStep * vx;
+            pos[2*i+1] += timeStep * vy;
+        }
+    });
 }
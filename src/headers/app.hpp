@@ -5,17 +5,140 @@
 #include "glad/gl.h"
 #include <GLFW/glfw3.h>
 #include <array>
+#include <vector>
+
+typedef enum {
+    DENSITY_NONE = 0,      // Edges blended over each other
+    DENSITY_LOG = 1,       // Edges and nodes summed, then scaled by the log of their density
+    DENSITY_HISTOGRAM = 2  // Same, with the densities equalized
+} densityType;
+
+// Communities of a level of the hierarchy drawn as single nodes, linked by one edge per pair of
+// communities with the summed weight of the edges between them. Built the first time the level is drawn.
+struct Aggregates {
+    size_t n_aggregates = 0;
+    bool built = false;
+    std::vector<size_t> aggregate; // Aggregate of every vertex
+    std::vector<GLint> ids;        // Community of every aggregate, for its color
+    std::vector<float> members;    // Number of vertices of every aggregate
+    std::vector<float> centers;    // Centroid of the members, updated when the positions changed
+    unsigned int frame = 0;        // Upload at which the centers were computed
+    size_t n_edges = 0;
+    float meanWeight = 0.0f;
+
+    GLuint VAO = 0;
+    GLuint VBO[5] = {}; // 0: centers, 1: sizes, 2: communities, 3: ends of the edges, 4: weights of the edges
+    GLuint TEX = 0;     // Buffer texture over the centers, read by the edges
+};
+
+// Uniform grid over the positions, stored as CSR, with about verticesPerCell vertices per cell.
+// The edges longer than a cell are listed apart : the others have both ends within a cell of any
+// rectangle they cross.
+struct Grid {
+    static const size_t verticesPerCell = 16;
+    unsigned int frame = 0; // Upload of the positions it was built from
+    float x0 = 0.0f, y0 = 0.0f, cell = 1.0f;
+    float maxSize = 0.0f; // Largest radius of a vertex
+    size_t nx = 0, ny = 0;
+    std::vector<size_t> cellStart, vertices;
+    std::vector<size_t> longEdges; // Ends of the long edges, two by two
+    std::vector<float> longWeights;
+};
 
 class App {
 
     public:
         // OpenGL objects
         GLFWwindow* window = nullptr;
-        GLuint VAO[2]; // 0: VAO for nodes, 1: VAO for edges
-        GLuint VBO[4]; // 0: base shape, 1 : color, 2: position, 3: size
-        GLuint EBO[1]; // EBO for lines
+        GLuint VAO[2]; // 0: VAO for nodes, 1: VAO for edges, drawn as instanced quads
+        GLuint VBO[4]; // 0: base shape, 1 : communities, 2: position, 3: size
+        GLuint paletteBuffer;
+        GLuint TEX[2]; // Buffer textures 0: communities of the vertices at every level, 1: palette
+        GLuint edgeVBO[2]; // Edges sorted by importance 0: ends, 1: weights
+        GLuint positionTexture; // Buffer texture over the segment of VBO[2] in use
+        size_t n_lines = 0;
+        float meanWeight = 1.0f;
+        float lineWidth = 1.0f; // Pixels, for an edge of average weight
         GLuint vertexShaderLines, fragmentShaderLines, lineShaderProgram;
         GLuint vertexShader, fragmentShader, nodeShaderProgram;
+        GLuint densityProgram, toneShaderProgram;
+
+        // Positions are streamed through a ring of n_segments segments of VBO[2], mapped once
+        // persistently. The fence of a segment is signaled once the GPU is done with the frame reading it.
+        static const int n_segments = 3;
+        unsigned char* posRing = nullptr;
+        size_t segmentBytes = 0;
+        GLsync segmentFence[n_segments] = {};
+        int segment = 0;
+
+        // Change tracking : only the vertices that moved since a segment was written are copied to it,
+        // nothing is uploaded when no step was computed (paused or converged)
+        std::vector<float> sentPos;            // Positions seen by the last upload
+        std::vector<unsigned int> movedFrame;  // Upload at which each vertex last moved
+        unsigned int segmentFrame[n_segments] = {};
+        unsigned int uploadFrame = 0;
+
+        // Compact attributes, chosen before init : positions as 16-bit coordinates normalized in a square
+        // box, sizes as 8-bit fractions of the largest size and communities as 16-bit ids when they fit.
+        // The box is padded and only fitted again when a vertex leaves it or the layout shrinks to less
+        // than half of it, the segments written with an older box are then copied entirely.
+        bool compactAttributes = false;
+        std::array<float, 4> box = {0.0f, 0.0f, 1.0f, 1.0f}; // min x, min y, width, height
+        std::array<float, 4> segmentBox[n_segments];
+        unsigned int boxFrame = 0;
+        float sizeScale = 1.0f;
+
+        // Level of detail : while the vertices are on average less than lodSpacing pixels apart, the finest
+        // level of the hierarchy whose communities are further apart is drawn as aggregates instead.
+        // The zoom at which a level gives way to a finer one grows with the square root of its size.
+        float lodSpacing = 4.0f; // 0 : always draw every vertex
+        int viewHeight = 600;    // Pixels
+        std::vector<Aggregates> aggregates; // One per level of the hierarchy
+        std::array<float, 4> bounds = {0.0f, 0.0f, 0.0f, 0.0f}; // min x, min y, max x, max y of the positions
+
+        // Edge budget : while the camera moves, only the edgeBudget most important edges are drawn,
+        // every edge once it stayed idle for idleDelay seconds. 0 : no budget.
+        size_t edgeBudget = 1000000;
+        double idleDelay = 0.2;
+        std::array<float, 4> lastView = {0.0f, 0.0f, 0.0f, 0.0f};
+        double lastCameraMove = 0.0;
+
+        // Scene cached in a texture, copied to the window while nothing changed
+        GLuint sceneFBO = 0, sceneTexture = 0;
+        int sceneWidth = 0, sceneHeight = 0;
+        bool sceneValid = false;
+        unsigned int sceneFrame = 0;
+        std::array<float, 4> sceneView = {0.0f, 0.0f, 0.0f, 0.0f};
+        int sceneLevel = -1;
+        bool sceneInteracting = false;
+
+        // Density mode, chosen before init : the scene is summed in densityTexture, then tone mapped to sceneFBO
+        densityType density = DENSITY_NONE;
+        static const int n_densityBins = 256;
+        GLuint densityFBO = 0, densityTexture = 0;
+        GLuint histogramBuffer = 0;
+        GLuint screenVAO = 0;
+
+        // Culling : zoomed in on less than half of the layout, only the vertices and edges in view are
+        // drawn. The grid is rebuilt when the positions changed, the query when the view changed too.
+        bool culling = true;
+        Grid grid;
+        GLuint cullVAO = 0;
+        GLuint cullVBO[3] = {}; // Visible vertices, as given to createInstances
+        GLuint cullEdgeVBO[2] = {}; // Visible edges, as in edgeVBO
+        size_t n_visibleVertices = 0, n_visibleEdges = 0;
+        std::array<float, 4> culledView = {0.0f, 0.0f, 0.0f, 0.0f};
+        unsigned int culledFrame = 0;
+        int culledLevel = -1;
+        std::vector<unsigned int> stamp; // Query in which every vertex was last found near the view
+        unsigned int stampValue = 0;
+
+        // Instrumentation, printed every second when enabled
+        bool instrumentation = false;
+        size_t statFrames = 0;
+        size_t statRenders = 0; // Frames drawn again rather than copied from the cache
+        size_t statUploadBytes = 0;
+        double statStart = 0.0;
 
         // User Interactions
         bool rightButtonPressed = false;
@@ -27,7 +150,7 @@ class App {
         float zoom = 1.0f;
         float aspectRatio = 1.0f;
         std::array<float, 4> sceneMVP = {0.0f, 0.0f, 0.0f, 0.0f};
-        std::vector<float> colors;
+        std::vector<float> colors; // Palette : RGB of every community
 
         // Graph 
         Graph* g = nullptr;
@@ -42,10 +165,39 @@ class App {
 
         // Draw a frame
         void draw();
+        bool idle() const;
+        void resizeScene(int width, int height);
+        void drawScene(const std::array<float, 4>& view, bool interacting);
+        void drawDensity(const std::array<float, 4>& view, bool interacting);
+        void uploadPositions(bool moved);
+        void bindPositionTexture();
+        void drawEdges(const GLuint* vbo, GLuint positions, const float* edgeBox, float weightScale, float opacity, size_t count);
+        size_t positionBytes() const;
+        void computeBounds();
+        bool fitBox(bool force);
+        void writePositions(unsigned char* dst, size_t begin, size_t end) const;
+        void reportStats();
+
+        // Colors : the node shader looks up the palette with the community of the vertex
+        // at the level g->curr_hierarchy, switching level only changes a uniform
+        void generateColors(size_t n_colors);
+        void loadCommunities();
+
+        // Level of detail
+        int lodLevel() const;
+        void drawGraph(size_t n_draw);
+        void drawAggregates(int level);
+        void buildAggregates(Aggregates& agg, int level);
+        void updateAggregates(Aggregates& agg);
+        void createInstances(GLuint& vao, const GLuint* vbo);
+        void drawInstances(GLuint vao, size_t count);
 
-        // Update colors 
-        void generateColors();
-        void updateColors();
+        // Culling
+        std::array<float, 4> viewRect() const;
+        bool cullView(const std::array<float, 4>& view) const;
+        void buildGrid();
+        void queryGrid(const std::array<float, 4>& view);
+        void drawCulled(const std::array<float, 4>& view);
 
         // scene 
         void computeTransform();
@@ -0,0 +1,17 @@
+#ifndef __COMPONENTS_HPP
+#define __COMPONENTS_HPP
+
+#include <cstddef>
+#include <vector>
+
+class Graph;
+
+// Label the connected components of g with a parallel union-find.
+// Components are numbered by their smallest vertex, returns the number of components.
+size_t connectedComponents(const Graph& g, std::vector<size_t>& component);
+
+// Shelf packing of rectangles, in the given order, into a roughly square area centered on 0.
+// x and y receive the center of each rectangle.
+void packRectangles(const std::vector<float>& width, const std::vector<float>& height, std::vector<float>& x, std::vector<float>& y);
+
+#endif // __COMPONENTS_HPP
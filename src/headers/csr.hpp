@@ -0,0 +1,65 @@
+#ifndef __CSR_HPP
+#define __CSR_HPP
+
+#include <cstddef>
+#include <stdio.h>
+#include <vector>
+
+// Read only array : the data of a vector or a part of a file mapped in memory
+template <typename T>
+struct ArrayView {
+    const T* data = nullptr;
+    size_t n = 0;
+
+    const T& operator[](size_t i) const { return data[i]; }
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+};
+
+// CSR representation of the graph. It is either built in the vectors, or read from a binary
+// CSR file mapped in memory so that graphs larger than the RAM are paged in from the storage.
+// The layouts only read the views.
+//
+// Binary CSR file, 64 bits little endian values, weights normalized by their maximum :
+//     "GRAPHCSR", version, n_vtx, n_edges (each edge counted twice),
+//     rowstart[n_vtx+1], adj[n_edges], adjw[n_edges] (double), vtxw[n_vtx]
+struct CSR {
+    std::vector<size_t> rowstart; // Index at which the neighbors of i starts in adj
+    std::vector<size_t> adj;  // Neighbor
+    std::vector<double> adjw; // Weight of the link
+
+    ArrayView<size_t> rowstartView, adjView;
+    ArrayView<double> adjwView;
+
+    CSR() {}
+    CSR(const CSR&) = delete;
+    CSR& operator=(const CSR&) = delete;
+    ~CSR();
+
+    // Point the views to the vectors, after they were modified. Drops the mapping.
+    void bind();
+
+    // Map a binary CSR file and point the views to it, vtxw is read in memory.
+    // Returns -1 if the file can't be opened or is not a binary CSR.
+    int map(const char* fname, size_t* nVtx, size_t* nEdges, std::vector<size_t>& vtxw);
+    bool mapped() const { return mapping != nullptr; }
+
+    // Hints for a pass over the edges [begin, end) of a mapped CSR : prefetch them,
+    // then release them once done. Do nothing when the CSR is in memory.
+    void prefetch(size_t begin, size_t end) const;
+    void release(size_t begin, size_t end) const;
+
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    void unmap();
+    void advise(size_t begin, size_t end, int advice, bool inner) const;
+};
+
+// True if the file starts like a binary CSR file
+bool isBinaryCSR(const char* fname);
+
+// Write the header of a binary CSR file, the arrays follow it.
+// Returns the size of the header in bytes, 0 if it couldn't be written.
+size_t writeCSRHeader(FILE* fh, size_t nVtx, size_t nEdges);
+
+#endif // __CSR_HPP
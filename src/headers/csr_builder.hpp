@@ -0,0 +1,24 @@
+#ifndef __CSR_BUILDER_HPP
+#define __CSR_BUILDER_HPP
+
+#include <cstddef>
+
+// Conversion of text graphs to binary CSR files (csr.hpp) without holding the graph in memory.
+// Functions return 0 on success, -1 otherwise.
+struct CSRBuilder {
+    size_t memoryLimit = (size_t) 1 << 30; // Bytes of edges kept in memory, shared by the runs sorted in parallel
+    bool verbose = true;
+    size_t maxFanIn = 64;      // Runs merged at once, the longer lists are merged in several passes
+    size_t reservedFiles = 16; // Open files left to the rest of the program when the limit is lower
+
+    // Graph in the format of readFile : its rows already come in order, they are streamed to the file
+    int fromAdjacency(const char* fgraph, const char* fcsr) const;
+
+    // Edge list, one "src dst [weight]" line per edge with 1-based vertex ids, each edge is
+    // stored in both directions. Runs sorted by source are written next to fcsr in parallel,
+    // each of at most memoryLimit / threads bytes, then merged into the CSR file by at most
+    // maxFanIn at a time, buffered within memoryLimit.
+    int fromEdgeList(const char* fedges, const char* fcsr) const;
+};
+
+#endif // __CSR_BUILDER_HPP
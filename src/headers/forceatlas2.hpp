@@ -0,0 +1,43 @@
+#ifndef __FORCEATLAS2_HPP
+#define __FORCEATLAS2_HPP
+
+#include <cstddef>
+#include <vector>
+#include "quadtree.hpp"
+
+class Graph;
+
+// ForceAtlas2 (Jacomy et al. 2014)
+//  - Repulsion scaled by (deg+1)(deg+1), approximated by Barnes-Hut when g.theta > 0
+//  - Per-node speed adapted from its swing (oscillation)
+//  - Global speed adapted from the ratio between total swing and total traction
+class ForceAtlas2 {
+
+    public:
+        // Parameters of the model
+        float scaling = 0.01f;           // Repulsion strength (kr)
+        float gravity = 1.0f;            // Gravity strength (kg)
+        float edgeWeightInfluence = 1.0f;// Attraction is multiplied by w^edgeWeightInfluence
+        float tolerance = 1.0f;          // Jitter tolerance, higher is faster but less precise
+        bool linlog = false;             // Use log(1+d) attraction instead of d
+        bool dissuadeHubs = false;       // Divide the attraction of a vertex by its mass
+        bool strongGravity = false;      // Gravity grows linearly with the distance to the center
+
+        // State of the simulation
+        float speed = 1.0f;
+        float speedEfficiency = 1.0f;
+        std::vector<float> mass;     // deg + 1
+        std::vector<float> force;    // Force of the current step
+        std::vector<float> oldForce; // Force of the previous step
+        QuadTree tree;               // Barnes-Hut repulsion, weighted by the masses
+
+        void init(const Graph& g);
+
+        // Compute one step of ForceAtlas2 on the positions pos (2*n_vtx floats)
+        void step(const Graph& g, float* pos);
+
+    private:
+        void adjustSpeed(double globalSwing, double globalTraction, size_t n);
+};
+
+#endif // __FORCEATLAS2_HPP
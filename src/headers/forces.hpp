@@ -0,0 +1,241 @@
+#ifndef __FORCES_HPP
+#define __FORCES_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "graph.hpp"
+#include "quadtree.hpp"
+#include "thread_pool.hpp"
+
+// Force models composed at compile time from force terms, for example
+//     g.model.reset(new Layout<Gravity, BarnesHutRepulsion, LinLogAttraction>());
+// The terms are inlined in a single pass over the awake vertices and their edges,
+// only the step of the whole model is a virtual call.
+
+// Compute one step of a layout on the positions of g
+class ForceModel {
+
+    public:
+        virtual ~ForceModel() {}
+        virtual void step(Graph& g) = 0;
+};
+
+// Base of the force terms, every function may be redefined :
+//  - prepare is called once per step before the forces are computed
+//  - vertex adds the force applied on the awake vertex i
+//  - edge adds the force applied on i by the edge (i, j) of weight w, (vx, vy) goes from i to j.
+//    Only called when edges is true.
+struct ForceTerm {
+    static const bool edges = false;
+    void prepare(const Graph&, const float*) {}
+    void vertex(size_t, const float*, float&, float&) const {}
+    void edge(float, float, float, float, float&, float&) const {}
+};
+
+// Pull every vertex towards the center of the canvas with a constant strength
+struct Gravity : ForceTerm {
+    float strength = 0.1f;
+
+    void vertex(size_t i, const float* pos, float& fx, float& fy) const {
+        const float norm = std::hypot(pos[2*i], pos[2*i+1]);
+        fx -= pos[2*i] / norm * strength;
+        fy -= pos[2*i+1] / norm * strength;
+    }
+};
+
+// Pull every vertex towards the center proportionally to its distance
+struct StrongGravity : ForceTerm {
+    float strength = 0.1f;
+
+    void vertex(size_t i, const float* pos, float& fx, float& fy) const {
+        fx -= pos[2*i] * strength;
+        fy -= pos[2*i+1] * strength;
+    }
+};
+
+// Repulsion strength / dist between every pair of vertices, computed exactly
+struct ExactRepulsion : ForceTerm {
+    float strength = 0.1f;
+    std::vector<float> force;
+
+    void prepare(const Graph& g, const float* pos){
+        force.assign(2*g.n_vtx, 0.0f);
+        g.pairwise(&force[0], [&](size_t i, size_t j, float& fx, float& fy){
+            // Direction from j to i
+            const float vx = pos[2*i] - pos[2*j];
+            const float vy = pos[2*i+1] - pos[2*j+1];
+            const float dist = vx*vx + vy*vy;
+            fx = vx/dist;
+            fy = vy/dist;
+        });
+    }
+    void vertex(size_t i, const float*, float& fx, float& fy) const {
+        fx += strength * force[2*i];
+        fy += strength * force[2*i+1];
+    }
+};
+
+// Same repulsion approximated by Barnes-Hut with the opening angle g.theta
+struct BarnesHutRepulsion : ForceTerm {
+    float strength = 0.1f;
+    QuadTree tree;
+    std::vector<float> force;
+
+    void prepare(const Graph& g, const float* pos){
+        force.resize(2*g.n_vtx);
+        tree.update(pos, nullptr, g.n_vtx);
+        tree.repulsion(pos, nullptr, &g.asleep[0], g.theta, &force[0]);
+    }
+    void vertex(size_t i, const float*, float& fx, float& fy) const {
+        fx += strength * force[2*i];
+        fy += strength * force[2*i+1];
+    }
+};
+
+// Attraction of constant strength along the edges
+struct Attraction : ForceTerm {
+    static const bool edges = true;
+    float strength = 1.0f;
+
+    void edge(float vx, float vy, float dist, float w, float& fx, float& fy) const {
+        fx += strength * w * vx / dist;
+        fy += strength * w * vy / dist;
+    }
+};
+
+// Springs : attraction proportional to the length of the edges
+struct LinearAttraction : ForceTerm {
+    static const bool edges = true;
+    float strength = 1.0f;
+
+    void edge(float vx, float vy, float, float w, float& fx, float& fy) const {
+        fx += strength * w * vx;
+        fy += strength * w * vy;
+    }
+};
+
+// Attraction in log(1 + dist) (Noack's LinLog model)
+struct LinLogAttraction : ForceTerm {
+    static const bool edges = true;
+    float strength = 1.0f;
+
+    void edge(float vx, float vy, float dist, float w, float& fx, float& fy) const {
+        if (dist <= 0.0f) return;
+        const float f = strength * w * std::log1p(dist) / dist;
+        fx += f * vx;
+        fy += f * vy;
+    }
+};
+
+template <typename... Terms>
+struct AnyEdges { static const bool value = false; };
+template <typename T, typename... Rest>
+struct AnyEdges<T, Rest...> { static const bool value = T::edges || AnyEdges<Rest...>::value; };
+
+// Sum of the force terms, integrated with forward Euler (time step dt) or by
+// Graph::integrateMomentum when g.momentum is set
+template <typename... Terms>
+class Layout : public ForceModel {
+
+    public:
+        std::tuple<Terms...> terms; // Parameters of the terms : std::get<Gravity>(layout.terms).strength
+        float dt = 1.0f/20.0f;
+
+        // A mapped CSR is streamed : the awake vertices are taken by blocks of about edgeBlock edges,
+        // the next block is prefetched during the current one, which is released afterwards
+        size_t edgeBlock = (size_t) 1 << 20;
+
+        void step(Graph& g) override {
+            float* pos = &g.pos[0];
+            prepare(g, pos, std::index_sequence_for<Terms...>());
+
+            force.resize(2*g.n_vtx);
+            const size_t n_active = g.active.size();
+            if (!AnyEdges<Terms...>::value || !g.csr->mapped()) forces(g, pos, 0, n_active);
+            else {
+                std::vector<size_t> blocks(1, 0);
+                size_t edges = 0;
+                for (size_t a = 0; a < n_active; a++){
+                    const size_t i = g.active[a];
+                    edges += g.rowstart[i+1] - g.rowstart[i];
+                    if (edges >= edgeBlock || a + 1 == n_active) {
+                        blocks.push_back(a + 1);
+                        edges = 0;
+                    }
+                }
+                auto edgeRange = [&](size_t b, size_t& begin, size_t& end){
+                    begin = g.rowstart[g.active[blocks[b]]];
+                    end = g.rowstart[g.active[blocks[b+1] - 1] + 1];
+                };
+
+                size_t begin, end;
+                if (blocks.size() > 1) { edgeRange(0, begin, end); g.csr->prefetch(begin, end); }
+                for (size_t b = 0; b + 1 < blocks.size(); b++){
+                    if (b + 2 < blocks.size()) { edgeRange(b + 1, begin, end); g.csr->prefetch(begin, end); }
+                    forces(g, pos, blocks[b], blocks[b+1]);
+                    edgeRange(b, begin, end);
+                    g.csr->release(begin, end);
+                }
+            }
+
+            if (g.momentum) g.integrateMomentum(&force[0]);
+            else {
+                for (const size_t i : g.active){
+                    pos[2*i] += dt*force[2*i];
+                    pos[2*i+1] += dt*force[2*i+1];
+                }
+            }
+        }
+
+    private:
+        std::vector<float> force;
+
+        // Forces on the awake vertices active[begin, end)
+        void forces(const Graph& g, const float* pos, size_t begin, size_t end){
+            threadPool().parallel_for(end - begin, [&](size_t first, size_t last){
+                for (size_t a = begin + first; a < begin + last; a++){
+                    const size_t i = g.active[a];
+                    float fx = 0.0f, fy = 0.0f;
+                    vertex(i, pos, fx, fy, std::index_sequence_for<Terms...>());
+                    if (AnyEdges<Terms...>::value) {
+                        for (size_t j = g.rowstart[i]; j < g.rowstart[i+1]; j++){
+                            const size_t neig = g.adj[j];
+                            // Direction from i to neig
+                            const float vx = pos[2*neig] - pos[2*i];
+                            const float vy = pos[2*neig+1] - pos[2*i+1];
+                            const float dist = std::hypot(vx, vy);
+                            edge(vx, vy, dist, (float) g.adjw[j], fx, fy, std::index_sequence_for<Terms...>());
+                        }
+                    }
+                    force[2*i] = fx;
+                    force[2*i+1] = fy;
+                }
+            });
+        }
+
+        // Call the function of every term, in order
+        template <size_t... I>
+        void prepare(const Graph& g, const float* pos, std::index_sequence<I...>){
+            const int expand[] = {0, (std::get<I>(terms).prepare(g, pos), 0)...};
+            (void) expand;
+        }
+        template <size_t... I>
+        void vertex(size_t i, const float* pos, float& fx, float& fy, std::index_sequence<I...>) const {
+            const int expand[] = {0, (std::get<I>(terms).vertex(i, pos, fx, fy), 0)...};
+            (void) expand;
+        }
+        template <size_t... I>
+        void edge(float vx, float vy, float dist, float w, float& fx, float& fy, std::index_sequence<I...>) const {
+            const int expand[] = {0, (std::get<I>(terms).edge(vx, vy, dist, w, fx, fy), 0)...};
+            (void) expand;
+        }
+};
+
+// Attraction - repulsion - gravity model of the default layout, with Barnes-Hut when g.theta > 0
+std::unique_ptr<ForceModel> defaultForceModel(const Graph& g);
+
+#endif // __FORCES_HPP
@@ -2,8 +2,14 @@
 #define __GRAPH_HPP
 #include <vector>
 #include <cstddef>
+#include <memory>
 #include "glad/gl.h"
 #include <GLFW/glfw3.h>
+#include "csr.hpp"
+#include "forceatlas2.hpp"
+#include "stress.hpp"
+#include "initial_layout.hpp"
+#include "thread_pool.hpp"
 
 struct Edge {
     size_t src;
@@ -33,16 +39,42 @@ struct EdgeComp {
     }
 };
 
+typedef enum {
+    LAYOUT_NONE = -1,      // Keep the initial layout
+    LAYOUT_DEFAULT = 0,    // Attraction - repulsion - gravity model
+    LAYOUT_FORCEATLAS2 = 1,
+    LAYOUT_STRESS = 2      // Stress majorization by SGD
+} layoutType;
+
+// Detect when the layout has settled : the root mean square displacement of a step,
+// relative to the size of the layout, stays below threshold for window steps.
+struct Convergence {
+    float threshold = 3e-4f;
+    int window = 50;
+
+    int stableSteps = 0;
+    bool converged = false;
+    float maxDisplacement = 0.0f; // Largest displacement of the last step
+    float energy = 0.0f;          // Kinetic energy of the last step : sum of squared displacements
+
+    // Returns true if the layout converged on this step
+    bool update(float maxDisp, float kineticEnergy, size_t n, float extent);
+    void reset();
+};
+
+class ForceModel;
+
 class Graph {
 
     public:
         size_t n_vtx;
         size_t n_edges;
 
-        // CSR representation of the graph
-        std::vector<size_t> rowstart; // Index at which the neighbors of i starts in adj
-        std::vector<size_t> adj;  // Neighbor
-        std::vector<double> adjw; // Weight of the link 
+        // CSR representation of the graph, read only : it is shared with the replicas of the graph
+        std::shared_ptr<CSR> csr;
+        const ArrayView<size_t>& rowstart;
+        const ArrayView<size_t>& adj;
+        const ArrayView<double>& adjw;
         std::vector<float> wDeg; // Weighted output degree of the vertex
         std::vector<size_t> vtxw; // Size of the vertex
 
@@ -53,14 +85,147 @@ class Graph {
 
         // Position of the vertices
         std::vector<float> pos;
-        std::vector<float> colors;
 
         Graph(const char* fedges, const char* fpart);
+        // Subgraph induced by vertices of parent, localIndex[v] is the index of v in vertices
+        Graph(const Graph& parent, const std::vector<size_t>& vertices, const std::vector<size_t>& localIndex);
+        // Replica of parent sharing its CSR, with its own layout started from init with seed
+        Graph(const Graph& parent, initType init, unsigned int seed);
+        ~Graph();
         void read_edgelist_file(const char* fedges);
         void read_partition_file(const char* fpart);
 
+        // Hop distance from source to every vertex, -1 if unreachable
+        void bfs(size_t source, std::vector<int>& dist) const;
+        // Choose k pivots by max-min distance and compute their distances to every vertex
+        void pivotDistances(size_t k, unsigned int seed, std::vector<size_t>& pivots, std::vector<std::vector<int>>& dist) const;
+
+        // Layout algorithm used by step()
+        layoutType layout = LAYOUT_DEFAULT;
+        ForceAtlas2 fa2;
+        StressSGD stress;
+
+        // Integration of the default layout : forward Euler with a constant time step, or momentum
+        // (leapfrog with damping) with a global time step that grows while the energy drops and is
+        // cut when the layout oscillates. A vertex moves at most maxMove per step.
+        bool momentum = false;
+        float damping = 0.9f;
+        float timeStep = 0.05f;
+        float minTimeStep = 0.01f, maxTimeStep = 1.0f;
+        float maxMove = 1.0f;
+        float forceEnergy = 0.0f; // Sum of the squared forces of the last step
+        std::vector<float> velocity;
+        void integrateMomentum(const float* force);
+
+        // Barnes-Hut approximation of the repulsion (default and ForceAtlas2 layouts),
+        // theta is the opening angle, 0 for the exact O(n^2) repulsion
+        float theta = 0.0f;
+
+        // Forces of the default layout (forces.hpp), built from the parameters on the first step
+        std::unique_ptr<ForceModel> model;
+
+        // Convergence of the layout, step() does nothing once converged
+        size_t n_steps = 0;
+        Convergence convergence;
+        std::vector<float> prevPos;
+
+        // Vertices whose displacement stays below sleepEpsilon (relative to the size of the layout)
+        // for sleepSteps steps fall asleep : they are no longer moved but still repulse the others.
+        // They are woken up when one of their neighbours moves more than wakeEpsilon.
+        bool sleeping = false;
+        float sleepEpsilon = 1e-4f;
+        float wakeEpsilon = 1e-3f;
+        int sleepSteps = 20;
+        std::vector<unsigned char> asleep;
+        std::vector<int> stillSteps;
+        std::vector<size_t> active;   // Awake vertices
+        std::vector<size_t> inactive; // Asleep vertices
+        void updateSleeping(float extent);
+
+        // Connected components are laid out independently then packed together
+        std::vector<std::vector<size_t>> componentVertices; // Vertices of each component, largest first
+        std::vector<std::unique_ptr<Graph>> components;      // Layout of each component, null for isolated vertices
+        bool verbose = true; // Report the convergence in the console
+        void decompose();
+        bool stepComponents(); // Returns true once every component converged
+        std::vector<float> slotX, slotY, slotWidth, slotHeight; // Center and size of the slot of each component
+        void packComponents(bool tight);
+
+        // Leaves (and chains of degree 2 vertices) are removed before the simulation :
+        // only the core is laid out, they are then placed analytically around it
+        std::unique_ptr<Graph> core;
+        std::vector<size_t> coreVertices;
+        std::vector<size_t> leafParents, leafStart, leaves; // Leaves of leafParents[p] : leaves[leafStart[p]..leafStart[p+1]]
+        std::vector<size_t> chainEnds, chainStart, chains;  // Chain c goes from chainEnds[2c] to chainEnds[2c+1]
+        std::vector<unsigned char> pruned;
+        void prune(bool pruneLeaves, bool pruneChains);
+        void reattach();
+
+        // Lay out the graph from runs seeds concurrently and keep the layout whose edge lengths vary
+        // the least. The replicas share the CSR, each only adds O(n) memory.
+        void multiStart(size_t runs, initType init, unsigned int seed, size_t maxSteps);
+        // Coefficient of variation of the edge lengths
+        double edgeLengthVariation() const;
+
+        // Add undirected edges to the CSR
+        void addEdges(const std::vector<Edge>& edges);
+
+        // Replace the positions by an initial layout
+        void initialLayout(initType init, unsigned int seed);
+
         // Compute one step of positionning algorithm
         void step();
+        void stepDefault();
+
+        // Exact repulsion : kernel(i, j, fx, fy) gives the force applied on i by j.
+        // Pairs of awake vertices are computed once (i gets +f, j gets -f), asleep vertices only push
+        // the awake ones. Pairs are processed by blocks in a fixed order, so that the sums do not
+        // depend on the number of threads.
+        template <typename F>
+        void pairwise(float* force, F kernel) const;
+
+        // Resume the simulation after the graph, hierarchy or parameters changed
+        void wake();
+
+    private:
+        // Same layout parameters as parent
+        void copyParameters(const Graph& parent);
 };
 
+template <typename F>
+void Graph::pairwise(float* force, F kernel) const {
+    static const unsigned int n_blocks = 16;
+    static const std::vector<std::vector<std::pair<unsigned int, unsigned int>>> rounds = blockRounds(n_blocks);
+    const size_t n_active = active.size();
+
+    for (const std::vector<std::pair<unsigned int, unsigned int>>& round : rounds){
+        threadPool().run(round.size(), [&](size_t t){
+            const unsigned int a = round[t].first;
+            const unsigned int b = round[t].second;
+            for (size_t x = n_active * a / n_blocks; x < n_active * (a+1) / n_blocks; x++){
+                const size_t i = active[x];
+                for (size_t y = (a == b ? x+1 : n_active * b / n_blocks); y < n_active * (b+1) / n_blocks; y++){
+                    const size_t j = active[y];
+                    float fx, fy;
+                    kernel(i, j, fx, fy);
+                    force[2*i] += fx; force[2*j] -= fx;
+                    force[2*i+1] += fy; force[2*j+1] -= fy;
+                }
+            }
+        });
+    }
+
+    threadPool().parallel_for(n_active, [&](size_t begin, size_t end){
+        for (size_t x = begin; x < end; x++){
+            const size_t i = active[x];
+            for (const size_t j : inactive){
+                float fx, fy;
+                kernel(i, j, fx, fy);
+                force[2*i] += fx;
+                force[2*i+1] += fy;
+            }
+        }
+    });
+}
+
 #endif // __GRAPH_HPP
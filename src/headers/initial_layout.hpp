@@ -0,0 +1,28 @@
+#ifndef __INITIAL_LAYOUT_HPP
+#define __INITIAL_LAYOUT_HPP
+
+#include <cstddef>
+
+class Graph;
+
+typedef enum {
+    INIT_RANDOM = 0,   // Uniform in [-1, 1]^2 (also done when reading the graph)
+    INIT_SPECTRAL = 1, // Eigenvectors of the Laplacian
+    INIT_PIVOT_MDS = 2 // Classical MDS on the distances to a few pivots
+} initType;
+
+// Uniform in [-1, 1]^2, from the raw output of a Mersenne twister : the same on every platform
+void randomLayout(const Graph& g, float* pos, unsigned int seed);
+
+// Both layouts cost O(m) per iteration and are scaled so that the mean edge length is 1.
+// Vertices given the same position are then moved apart by a small jitter drawn from seed.
+
+// Koren, "Drawing graphs by eigenvectors" : the two first non-trivial eigenvectors of the
+// generalized problem L x = lambda D x, found by power iteration on (I + D^-1 A) / 2.
+// A graph that isn't connected gets a random layout instead.
+void spectralLayout(const Graph& g, float* pos, unsigned int seed);
+
+// Brandes & Pich, "Eigensolver methods for progressive multidimensional scaling of large data"
+void pivotMDSLayout(const Graph& g, float* pos, size_t pivots, unsigned int seed);
+
+#endif // __INITIAL_LAYOUT_HPP
@@ -50,4 +50,7 @@ int readEdgeNodeWeighted(
     std::vector<size_t>& vtxw
 );
 
+// Write the positions of the vertices, one "x,y" line per vertex
+int writePositions(const char *fname, size_t nVtx, const std::vector<float>& pos);
+
 #endif // __IO_HPP
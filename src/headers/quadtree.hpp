@@ -0,0 +1,56 @@
+#ifndef __QUADTREE_HPP
+#define __QUADTREE_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Quadtree over the positions of the vertices for the Barnes-Hut approximation of the repulsion.
+// The tree is kept between steps : as vertices only move a little, the cells are kept and
+// only the vertices that left their cell are reinserted, then masses and bounds are refit
+// bottom-up. It is rebuilt from scratch when too many vertices moved or the tree degraded.
+class QuadTree {
+
+    public:
+        struct Node {
+            float cx, cy, half;           // Cell : square of center (cx, cy) and half side half
+            float minx, miny, maxx, maxy; // Bounding box of the vertices of the node
+            float mass, mx, my;           // Total mass and center of mass
+            unsigned int child;           // Index of the first of the 4 children, 0 for a leaf
+            unsigned int depth;
+            std::vector<unsigned int> vertices; // Vertices of a leaf
+        };
+
+        // Parameters
+        size_t leafSize = 16;          // Vertices in a leaf before it is split
+        unsigned int maxDepth = 24;    // At most 32
+        float rebuildFraction = 0.05f; // Rebuild when more vertices than this left their cell
+        float growthFactor = 2.0f;     // Rebuild when the number of nodes grew by this factor
+        float shrinkFactor = 0.25f;    // Rebuild when the layout shrank below this fraction of the root
+
+        std::vector<Node> nodes;          // Children are always stored after their parent
+        std::vector<unsigned int> leafOf; // Leaf of each vertex
+        std::vector<unsigned int> slot;   // Index of each vertex in the vertices of its leaf
+        size_t n_builds = 0;              // Number of builds from scratch
+
+        // Build the tree from scratch, mass may be null for unit masses
+        void build(const float* pos, const float* mass, size_t n);
+
+        // Follow the new positions, rebuild the tree if needed
+        void update(const float* pos, const float* mass, size_t n);
+
+        // Repulsion sum_j m_j (p_i - p_j) / |p_i - p_j|^2 written in force (2*n floats) for the
+        // vertices of every leaf that has an awake vertex (asleep may be null).
+        // Each leaf walks the tree once : nodes seen under an angle smaller than theta from its whole
+        // bounding box are approximated, the resulting interaction list is shared by its vertices.
+        void repulsion(const float* pos, const float* mass, const unsigned char* asleep, float theta, float* force) const;
+
+    private:
+        size_t builtNodes = 0; // Number of nodes after the last build
+
+        void insert(unsigned int v, const float* pos);
+        void split(unsigned int node, const float* pos);
+        void refit(const float* pos, const float* mass);
+        bool inside(const Node& node, float x, float y) const;
+};
+
+#endif // __QUADTREE_HPP
@@ -3,3 +3,4 @@
 
 GLuint loadShaders(const char* fpath, GLuint shader_type);
 GLuint loadProgram(GLuint vtxShaderId, GLuint fragShaderId);
+GLuint loadComputeProgram(GLuint computeShaderId);
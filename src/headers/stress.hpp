@@ -0,0 +1,53 @@
+#ifndef __STRESS_HPP
+#define __STRESS_HPP
+
+#include <cstddef>
+#include <vector>
+
+class Graph;
+
+// Stress majorization by stochastic gradient descent (Zheng et al. 2018)
+//  - Shortest path distances are computed with BFS
+//  - Small graphs use every pair of vertices, large graphs use the sparse
+//    approximation of Ortmann et al. : the edges plus the distances to a few pivots,
+//    so that memory stays O(n * pivots)
+//  - Pair updates are shuffled and run in parallel : vertices are split in blocks
+//    and each round processes pairs of blocks that share no vertex
+class StressSGD {
+
+    public:
+        // Parameters of the model
+        size_t pivots = 50;            // Number of pivots of the sparse approximation
+        size_t maxExactVertices = 2000;// Use all pairs up to this number of vertices
+        int epochs = 30;               // Epochs of the annealing schedule
+        float epsilon = 0.1f;          // Final step size relative to the smallest weight
+        unsigned int seed = 42;
+
+        // A term pulls i and j towards distance d, with weight wi (resp. wj) applied to i (resp. j)
+        struct Term {
+            unsigned int i, j;
+            float d, wi, wj;
+        };
+
+        // State of the simulation
+        int epoch = 0;
+        float etaMax = 1.0f, etaMin = 1.0f, lambda = 0.0f;
+        std::vector<std::vector<Term>> buckets; // Terms grouped by pair of vertex blocks
+
+        void init(const Graph& g);
+
+        // Compute one epoch of SGD on the positions pos (2*n_vtx floats)
+        void step(const Graph& g, float* pos);
+
+    private:
+        static const unsigned int n_blocks = 16; // Fixed so that results do not depend on the number of threads
+        std::vector<std::vector<size_t>> rounds; // Buckets that can be processed concurrently
+        size_t n_vtx = 0;
+
+        size_t bucketIndex(unsigned int a, unsigned int b) const;
+        void addTerm(const Term& t);
+        void initExact(const Graph& g);
+        void initSparse(const Graph& g);
+};
+
+#endif // __STRESS_HPP
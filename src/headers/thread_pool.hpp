@@ -0,0 +1,62 @@
+#ifndef __THREAD_POOL_HPP
+#define __THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed set of worker threads executing batches of independent tasks.
+// The calling thread takes part in the batch. Calls made from inside a task
+// (nested parallelism) are executed serially by the calling thread.
+class ThreadPool {
+
+    public:
+        ThreadPool(size_t n_threads);
+        ~ThreadPool();
+
+        size_t size() const { return workers.size() + 1; }
+
+        // Run task(i) for every i in [0, n_tasks) and wait for all of them
+        void run(size_t n_tasks, const std::function<void(size_t)>& task);
+
+        // Split [0, n) into contiguous chunks and run body(begin, end) on each of them
+        void parallel_for(size_t n, const std::function<void(size_t, size_t)>& body);
+
+        // Split [0, n) into blocks of blockSize whatever the number of threads and run
+        // body(block, begin, end) on each of them. Partial results kept per block and combined
+        // in block order give the same result on any number of threads.
+        void blocks(size_t n, size_t blockSize, const std::function<void(size_t, size_t, size_t)>& body);
+
+    private:
+        std::vector<std::thread> workers;
+        std::mutex batchMutex; // Only one batch at a time
+        std::mutex mutex;
+        std::condition_variable wakeWorkers, batchDone;
+        bool stopping = false;
+        size_t generation = 0;
+
+        // Current batch, every worker takes part in every batch
+        const std::function<void(size_t)>* task = nullptr;
+        size_t n_tasks = 0;
+        std::atomic<size_t> nextTask{0};
+        size_t finishedWorkers = 0;
+
+        void workerLoop();
+        void work(const std::function<void(size_t)>& f, size_t n);
+};
+
+// Pool shared by the whole application, sized to the number of cores unless set otherwise
+ThreadPool& threadPool();
+// Replace the shared pool, not while it runs a batch
+void setThreadCount(size_t n_threads);
+
+// Round robin tournament between n_blocks blocks (even) : every round is a set of pairs of blocks
+// sharing no block, so that they can be processed concurrently. The first round holds the pairs (a, a).
+std::vector<std::vector<std::pair<unsigned int, unsigned int>>> blockRounds(unsigned int n_blocks);
+
+#endif // __THREAD_POOL_HPP
@@ -0,0 +1,223 @@
+#include "headers/initial_layout.hpp"
+#include "headers/components.hpp"
+#include "headers/graph.hpp"
+#include "headers/thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+// Scale the layout so that the mean edge length is 1, and center it
+static void normalizeLayout(const Graph& g, float* pos){
+    const size_t n = g.n_vtx;
+    double cx = 0.0, cy = 0.0;
+    for (size_t i = 0; i < n; i++){ cx += pos[2*i]; cy += pos[2*i+1]; }
+    cx /= n; cy /= n;
+
+    double length = 0.0;
+    size_t n_links = 0;
+    for (size_t i = 0; i < n; i++){
+        for (size_t j = g.rowstart[i]; j < g.rowstart[i+1]; j++){
+            const size_t neig = g.adj[j];
+            length += std::hypot(pos[2*i] - pos[2*neig], pos[2*i+1] - pos[2*neig+1]);
+            n_links++;
+        }
+    }
+    const double scale = (n_links > 0 && length > 0.0) ? n_links / length : 1.0;
+
+    for (size_t i = 0; i < n; i++){
+        pos[2*i]   = (float) ((pos[2*i]   - cx) * scale);
+        pos[2*i+1] = (float) ((pos[2*i+1] - cy) * scale);
+    }
+}
+
+// Structurally equivalent vertices (leaves of the same parent...) get the same position, where the
+// forces divide by a zero distance : they are moved apart by a jitter small against the edges
+static void separateCoincident(const Graph& g, float* pos, unsigned int seed){
+    const size_t n = g.n_vtx;
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b){
+        return pos[2*a] < pos[2*b] || (pos[2*a] == pos[2*b] && pos[2*a+1] < pos[2*b+1]);
+    });
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+    for (size_t begin = 0; begin < n;){
+        size_t end = begin + 1;
+        while (end < n && pos[2*order[end]] == pos[2*order[begin]] && pos[2*order[end]+1] == pos[2*order[begin]+1]) end++;
+        if (end - begin > 1) {
+            for (size_t k = begin; k < end; k++){
+                pos[2*order[k]] += jitter(rng);
+                pos[2*order[k]+1] += jitter(rng);
+            }
+        }
+        begin = end;
+    }
+}
+
+static double dot(const std::vector<double>& a, const std::vector<double>& b){
+    double res = 0.0;
+    for (size_t i = 0; i < a.size(); i++) res += a[i] * b[i];
+    return res;
+}
+
+static void normalize(std::vector<double>& a){
+    const double norm = std::sqrt(dot(a, a));
+    if (norm > 0.0) for (double& v : a) v /= norm;
+}
+
+void randomLayout(const Graph& g, float* pos, unsigned int seed){
+    std::mt19937 rng(seed);
+    for (size_t i = 0; i < 2*g.n_vtx; i++) pos[i] = -1.0f + 2.0f * (float) (rng() >> 8) / 16777216.0f;
+}
+
+void spectralLayout(const Graph& g, float* pos, unsigned int seed){
+    const size_t n = g.n_vtx;
+
+    // Every component would be collapsed to a point by the trivial eigenvectors of the others
+    std::vector<size_t> component;
+    if (connectedComponents(g, component) > 1) {
+        printf("The graph isn't connected, random initial layout instead of spectral\n");
+        randomLayout(g, pos, seed);
+        return;
+    }
+    const int maxIter = 1000;
+    const double tolerance = 1e-7;
+
+    std::vector<double> deg(n, 0.0);
+    for (size_t i = 0; i < n; i++){
+        for (size_t j = g.rowstart[i]; j < g.rowstart[i+1]; j++) deg[i] += g.adjw[j];
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+    // u[0] is the trivial eigenvector (constant), u[1] and u[2] are the coordinates
+    std::vector<std::vector<double>> u(3, std::vector<double>(n, 1.0));
+    normalize(u[0]);
+    std::vector<double> next(n);
+    for (int k = 1; k < 3; k++){
+        for (size_t i = 0; i < n; i++) u[k][i] = uniform(rng);
+        normalize(u[k]);
+
+        for (int iter = 0; iter < maxIter; iter++){
+            // D-orthogonalize against the previous eigenvectors
+            for (int l = 0; l < k; l++){
+                double num = 0.0, den = 0.0;
+                for (size_t i = 0; i < n; i++){
+                    num += u[k][i] * deg[i] * u[l][i];
+                    den += u[l][i] * deg[i] * u[l][i];
+                }
+                if (den <= 0.0) continue;
+                const double coef = num / den;
+                for (size_t i = 0; i < n; i++) u[k][i] -= coef * u[l][i];
+            }
+
+            // next = (I + D^-1 A) u / 2
+            const std::vector<double>& curr = u[k];
+            threadPool().parallel_for(n, [&](size_t begin, size_t end){
+                for (size_t i = begin; i < end; i++){
+                    if (deg[i] <= 0.0) { next[i] = curr[i]; continue; }
+                    double s = 0.0;
+                    for (size_t j = g.rowstart[i]; j < g.rowstart[i+1]; j++) s += g.adjw[j] * curr[g.adj[j]];
+                    next[i] = 0.5 * (curr[i] + s / deg[i]);
+                }
+            });
+            normalize(next);
+
+            const double change = dot(next, u[k]);
+            std::swap(next, u[k]);
+            if (std::fabs(change) > 1.0 - tolerance) break;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++){
+        pos[2*i]   = (float) u[1][i];
+        pos[2*i+1] = (float) u[2][i];
+    }
+    normalizeLayout(g, pos);
+    separateCoincident(g, pos, seed);
+}
+
+void pivotMDSLayout(const Graph& g, float* pos, size_t pivots, unsigned int seed){
+    const size_t n = g.n_vtx;
+    std::vector<size_t> pivot;
+    std::vector<std::vector<int>> dist;
+    g.pivotDistances(pivots, seed, pivot, dist);
+    const size_t k = pivot.size();
+    if (k < 2) return;
+
+    // Unreachable vertices are put just after the farthest one
+    int maxDist = 0;
+    for (size_t p = 0; p < k; p++) maxDist = std::max(maxDist, *std::max_element(dist[p].begin(), dist[p].end()));
+
+    // Double centering of the squared distances (n x k, stored by pivot)
+    std::vector<double> c(n * k);
+    std::vector<double> rowMean(n, 0.0), colMean(k, 0.0);
+    double mean = 0.0;
+    for (size_t p = 0; p < k; p++){
+        for (size_t i = 0; i < n; i++){
+            const double d = dist[p][i] >= 0 ? dist[p][i] : maxDist + 1;
+            c[p*n + i] = d*d;
+            rowMean[i] += d*d / k;
+            colMean[p] += d*d / n;
+        }
+        mean += colMean[p] / k;
+    }
+    for (size_t p = 0; p < k; p++){
+        for (size_t i = 0; i < n; i++) c[p*n + i] = -0.5 * (c[p*n + i] - rowMean[i] - colMean[p] + mean);
+    }
+
+    // b = C^T C (k x k)
+    std::vector<double> b(k * k);
+    threadPool().run(k, [&](size_t p){
+        for (size_t q = 0; q < k; q++){
+            double s = 0.0;
+            for (size_t i = 0; i < n; i++) s += c[p*n + i] * c[q*n + i];
+            b[p*k + q] = s;
+        }
+    });
+
+    // Two dominant eigenvectors of b by power iteration
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::vector<std::vector<double>> v(2, std::vector<double>(k));
+    std::vector<double> next(k);
+    for (int e = 0; e < 2; e++){
+        for (size_t p = 0; p < k; p++) v[e][p] = uniform(rng);
+        normalize(v[e]);
+        for (int iter = 0; iter < 1000; iter++){
+            if (e == 1) {
+                const double coef = dot(v[1], v[0]);
+                for (size_t p = 0; p < k; p++) v[1][p] -= coef * v[0][p];
+            }
+            for (size_t p = 0; p < k; p++){
+                double s = 0.0;
+                for (size_t q = 0; q < k; q++) s += b[p*k + q] * v[e][q];
+                next[p] = s;
+            }
+            normalize(next);
+            const double change = dot(next, v[e]);
+            std::swap(next, v[e]);
+            if (std::fabs(change) > 1.0 - 1e-10) break;
+        }
+    }
+
+    // Coordinates : C v
+    threadPool().parallel_for(n, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            double x = 0.0, y = 0.0;
+            for (size_t p = 0; p < k; p++){
+                x += c[p*n + i] * v[0][p];
+                y += c[p*n + i] * v[1][p];
+            }
+            pos[2*i] = (float) x;
+            pos[2*i+1] = (float) y;
+        }
+    });
+    normalizeLayout(g, pos);
+    separateCoincident(g, pos, seed);
+}
@@ -111,10 +111,10 @@ int readFile(const char *fname, size_t* nVtx, size_t* nEdges, std::vector<size_t
 
     *nEdges *= 2; // Edges are put twice
 
-    rowstart.reserve((*nVtx)+1);
-    adj.reserve(*nEdges);
-    vtxw.reserve(*nVtx);
-    adjw.reserve(*nEdges);
+    rowstart.resize((*nVtx)+1);
+    adj.resize(*nEdges);
+    vtxw.resize(*nVtx);
+    adjw.resize(*nEdges);
 
     switch(weightType){
 
@@ -144,3 +144,12 @@ int readFile(const char *fname, size_t* nVtx, size_t* nEdges, std::vector<size_t
     return 0;
 }
 
+int writePositions(const char *fname, size_t nVtx, const std::vector<float>& pos){
+    FILE* fh = fopen(fname, "w");
+    if (fh == NULL) return -1;
+
+    for (size_t i = 0; i < nVtx; i++) fprintf(fh, "%.9g,%.9g\n", pos[2*i], pos[2*i+1]);
+
+    fclose(fh);
+    return 0;
+}
@@ -2,8 +2,12 @@
 #include <GLFW/glfw3.h>
 #include "headers/shader_functions.hpp"
 #include "headers/app.hpp"
+#include "headers/csr_builder.hpp"
 #include "headers/graph.hpp"
+#include "headers/io.hpp"
+#include "headers/thread_pool.hpp"
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <complex>
 #include <cstddef>
@@ -11,6 +15,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <vector>
 #include <array>
 #include <argp.h>
@@ -21,14 +26,90 @@ const char *argp_program_version = "alpha";
 static char doc[] = "Display networks using OpenGL";
 
 static char args_doc[] = "edgefile partitionfile";
-static struct argp_option options[3] = {
-    {"edge",      'e', "FILE", 0, "File containing the edge list of the graph", 0 },
-    {"partition", 'p', "FILE", 0, "File containing the partitioning"          , 0 },
+// Keys of the options without short version
+enum {
+    OPT_LINLOG = 256,
+    OPT_DISSUADE_HUBS,
+    OPT_SLEEP,
+    OPT_PIVOTS,
+    OPT_PRUNE_LEAVES,
+    OPT_PRUNE_CHAINS,
+    OPT_THETA,
+    OPT_SEED,
+    OPT_MOMENTUM,
+    OPT_RUNS,
+    OPT_WRITE_CSR,
+    OPT_EDGE_LIST,
+    OPT_MEMORY,
+    OPT_STATS,
+    OPT_COMPACT,
+    OPT_LOD,
+    OPT_NO_CULL,
+    OPT_EDGE_BUDGET,
+    OPT_LINE_WIDTH,
+    OPT_DENSITY
+};
+
+static struct argp_option options[30] = {
+    {"edge",          'e', "FILE", 0, "File containing the edge list of the graph, or a binary CSR file", 0 },
+    {"partition",     'p', "FILE", 0, "File containing the partitioning"          , 0 },
+    {"layout",        'l', "NAME", 0, "Layout algorithm : default, fa2, stress, none", 0 },
+    {"init",          'i', "NAME", 0, "Initial layout : random, spectral, pmds"   , 0 },
+    {"linlog",        OPT_LINLOG,        0, 0, "ForceAtlas2 : use the LinLog attraction"  , 0 },
+    {"dissuade-hubs", OPT_DISSUADE_HUBS, 0, 0, "ForceAtlas2 : dissuade hubs"              , 0 },
+    {"momentum",      OPT_MOMENTUM,      0, 0, "Default layout : momentum integrator with an adaptive time step", 0 },
+    {"pivots",        OPT_PIVOTS,      "K", 0, "Stress : number of pivots for large graphs", 0 },
+    {"theta",         OPT_THETA,       "T", 0, "Barnes-Hut repulsion with opening angle T (default 0 : exact)", 0 },
+    {"components",    'c', 0,      0, "Lay out connected components independently", 0 },
+    {"prune-leaves",  OPT_PRUNE_LEAVES,  0, 0, "Place degree 1 vertices around their neighbour instead of simulating them", 0 },
+    {"prune-chains",  OPT_PRUNE_CHAINS,  0, 0, "Place chains of degree 2 vertices between their ends instead of simulating them", 0 },
+    {"sleep",         OPT_SLEEP,         0, 0, "Vertices that stop moving fall asleep"   , 0 },
+    {"runs",          OPT_RUNS,        "K", 0, "Lay out from K seeds concurrently and keep the most regular layout", 0 },
+    {"seed",          OPT_SEED,        "S", 0, "Seed of the random choices (default 42)", 0 },
+    {"threads",       't', "N",    0, "Number of threads (default : number of cores)", 0 },
+    {"headless",      'H', 0,      0, "Compute the layout without opening a window", 0 },
+    {"stats",         OPT_STATS,         0, 0, "Print the frame rate, the scene renders and the GPU upload volume every second", 0 },
+    {"compact",       OPT_COMPACT,       0, 0, "Quantized vertex attributes : 16-bit positions, 8-bit sizes", 0 },
+    {"lod",           OPT_LOD,        "PX", 0, "Draw communities as single nodes while vertices are closer than PX pixels (default 4, 0 : never)", 0 },
+    {"no-cull",       OPT_NO_CULL,       0, 0, "Draw every vertex and edge even when zoomed in", 0 },
+    {"edge-budget",   OPT_EDGE_BUDGET,  "N", 0, "Only draw the N most important edges while panning or zooming (default 1000000, 0 : all)", 0 },
+    {"line-width",    OPT_LINE_WIDTH,  "PX", 0, "Width of an edge of average weight (default 1)", 0 },
+    {"density",       OPT_DENSITY,   "MODE", 0, "Sum edges and nodes additively, scaled by : log, hist (histogram equalization)", 0 },
+    {"steps",         'n', "N",    0, "Headless : maximum number of steps (default 10000)", 0 },
+    {"output",        'o', "FILE", 0, "Headless : write the final positions to FILE", 0 },
+    {"write-csr",     OPT_WRITE_CSR, "FILE", 0, "Convert the graph to a binary CSR file, mapped from storage when given to -e, and exit", 0 },
+    {"edge-list",     OPT_EDGE_LIST,   0, 0, "Convert : the graph is a list of 'src dst [weight]' lines, with 1-based ids", 0 },
+    {"memory",        OPT_MEMORY,    "MB", 0, "Convert : memory used to sort the edge list (default 1024)", 0 },
     {0, 0, 0, 0, 0, 0}
 };
 
 struct arguments {
     const char *edgefile, *partfile;
+    layoutType layout;
+    initType init;
+    bool linlog, dissuadeHubs;
+    bool sleeping;
+    bool momentum;
+    bool components;
+    bool pruneLeaves, pruneChains;
+    size_t pivots;
+    float theta;
+    unsigned int seed;
+    size_t runs;
+    size_t threads;
+    bool headless;
+    bool stats;
+    bool compact;
+    float lodSpacing;
+    bool culling;
+    size_t edgeBudget;
+    float lineWidth;
+    densityType density;
+    size_t maxSteps;
+    const char *outfile;
+    const char *csrfile;
+    bool edgeList;
+    size_t memory;
 };
 
 static error_t parse_opt (int key, char *arg, struct argp_state *state) {
@@ -43,6 +124,96 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
         case 'p':
             arguments->partfile = arg;
             break;
+        case 'l':
+            if (strcmp(arg, "default") == 0) arguments->layout = LAYOUT_DEFAULT;
+            else if (strcmp(arg, "fa2") == 0) arguments->layout = LAYOUT_FORCEATLAS2;
+            else if (strcmp(arg, "stress") == 0) arguments->layout = LAYOUT_STRESS;
+            else if (strcmp(arg, "none") == 0) arguments->layout = LAYOUT_NONE;
+            else argp_error(state, "Unknown layout '%s'", arg);
+            break;
+        case 'i':
+            if (strcmp(arg, "random") == 0) arguments->init = INIT_RANDOM;
+            else if (strcmp(arg, "spectral") == 0) arguments->init = INIT_SPECTRAL;
+            else if (strcmp(arg, "pmds") == 0) arguments->init = INIT_PIVOT_MDS;
+            else argp_error(state, "Unknown initial layout '%s'", arg);
+            break;
+        case OPT_LINLOG:
+            arguments->linlog = true;
+            break;
+        case OPT_DISSUADE_HUBS:
+            arguments->dissuadeHubs = true;
+            break;
+        case OPT_MOMENTUM:
+            arguments->momentum = true;
+            break;
+        case OPT_PIVOTS:
+            arguments->pivots = strtoul(arg, NULL, 10);
+            break;
+        case OPT_THETA:
+            arguments->theta = strtof(arg, NULL);
+            break;
+        case 'c':
+            arguments->components = true;
+            break;
+        case OPT_PRUNE_LEAVES:
+            arguments->pruneLeaves = true;
+            break;
+        case OPT_PRUNE_CHAINS:
+            arguments->pruneChains = true;
+            break;
+        case OPT_SLEEP:
+            arguments->sleeping = true;
+            break;
+        case OPT_RUNS:
+            arguments->runs = strtoul(arg, NULL, 10);
+            break;
+        case OPT_SEED:
+            arguments->seed = strtoul(arg, NULL, 10);
+            break;
+        case 't':
+            arguments->threads = strtoul(arg, NULL, 10);
+            break;
+        case 'H':
+            arguments->headless = true;
+            break;
+        case OPT_STATS:
+            arguments->stats = true;
+            break;
+        case OPT_COMPACT:
+            arguments->compact = true;
+            break;
+        case OPT_LOD:
+            arguments->lodSpacing = strtof(arg, NULL);
+            break;
+        case OPT_NO_CULL:
+            arguments->culling = false;
+            break;
+        case OPT_EDGE_BUDGET:
+            arguments->edgeBudget = strtoul(arg, NULL, 10);
+            break;
+        case OPT_LINE_WIDTH:
+            arguments->lineWidth = strtof(arg, NULL);
+            break;
+        case OPT_DENSITY:
+            if (strcmp(arg, "log") == 0) arguments->density = DENSITY_LOG;
+            else if (strcmp(arg, "hist") == 0) arguments->density = DENSITY_HISTOGRAM;
+            else argp_error(state, "Unknown density scale '%s'", arg);
+            break;
+        case 'n':
+            arguments->maxSteps = strtoul(arg, NULL, 10);
+            break;
+        case 'o':
+            arguments->outfile = arg;
+            break;
+        case OPT_WRITE_CSR:
+            arguments->csrfile = arg;
+            break;
+        case OPT_EDGE_LIST:
+            arguments->edgeList = true;
+            break;
+        case OPT_MEMORY:
+            arguments->memory = strtoul(arg, NULL, 10);
+            break;
 
         case ARGP_KEY_ARG: {
                /* Too many arguments. */
@@ -68,16 +239,73 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
 
 static struct argp argp = { options, parse_opt, args_doc, doc, 0, 0, 0};
 
+// Wall time since start, glfw isn't initialized in headless mode
+static double secondsSince(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Apply the command line options to the graph
+void setupGraph(Graph* g, struct arguments* args){
+    g->layout = args->layout;
+    g->fa2.linlog = args->linlog;
+    g->fa2.dissuadeHubs = args->dissuadeHubs;
+    g->sleeping = args->sleeping;
+    g->momentum = args->momentum;
+    g->stress.pivots = args->pivots;
+    g->theta = args->theta;
+
+    g->stress.seed = args->seed;
+
+    // Every run starts from its own initial layout
+    if (args->runs > 1) {
+        const auto start = std::chrono::steady_clock::now();
+        g->multiStart(args->runs, args->init, args->seed, args->maxSteps);
+        printf("%zu runs computed in %.3f s\n", args->runs, secondsSince(start));
+        return;
+    }
+
+    // Random positions are drawn again in case the seed changed
+    const auto start = std::chrono::steady_clock::now();
+    g->initialLayout(args->init, args->seed);
+    if (args->init != INIT_RANDOM) printf("Initial layout computed in %.3f s\n", secondsSince(start));
+
+    // The core left by the pruning is the graph that gets decomposed
+    if (args->pruneLeaves || args->pruneChains) g->prune(args->pruneLeaves, args->pruneChains);
+    if (args->components) {
+        if (g->core) g->core->decompose();
+        else g->decompose();
+    }
+}
+
+// Compute the layout without any window, until convergence or maxSteps
+int runHeadless(struct arguments* args){
+    Graph g(args->edgefile, args->partfile);
+    setupGraph(&g, args);
+
+    while (g.n_steps < args->maxSteps && !g.convergence.converged) g.step();
+
+    if (g.convergence.converged) printf("Converged in %zu steps\n", g.n_steps);
+    else printf("Not converged after %zu steps (max displacement %g, energy %g)\n",
+                g.n_steps, g.convergence.maxDisplacement, g.convergence.energy);
+
+    if (args->outfile != NULL && writePositions(args->outfile, g.n_vtx, g.pos) != 0) {
+        printf("File : %s couldn't be written\n", args->outfile);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
 
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) app.paused = !app.paused; 
+    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
+        app.paused = !app.paused; 
+        if (!app.paused) app.g->wake();
+    }
     if (key == GLFW_KEY_RIGHT && action == GLFW_PRESS) {
         app.g->curr_hierarchy = std::min(app.g->curr_hierarchy + 1, app.g->n_hierarchy - 1); 
-        app.updateColors();
     }
     if (key == GLFW_KEY_LEFT && action == GLFW_PRESS) {
         app.g->curr_hierarchy = std::max(app.g->curr_hierarchy - 1, 0); 
-        app.updateColors();
     }
 }
 
@@ -85,6 +313,7 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 void framebufferSizeCallback(GLFWwindow* window, int width, int height){
     glViewport(0, 0, width, height);
     app.aspectRatio = ((float) height)/width;
+    app.viewHeight = height;
 }  
 
 // Callback on scrolling with mouse or pad. 
@@ -162,8 +391,65 @@ int main(int argc, char** argv){
     struct arguments args;
     args.edgefile = NULL;
     args.partfile = NULL;
+    args.layout = LAYOUT_DEFAULT;
+    args.init = INIT_RANDOM;
+    args.linlog = false;
+    args.dissuadeHubs = false;
+    args.sleeping = false;
+    args.momentum = false;
+    args.components = false;
+    args.pruneLeaves = false;
+    args.pruneChains = false;
+    args.pivots = 50;
+    args.theta = 0.0f;
+    args.seed = 42;
+    args.runs = 1;
+    args.threads = 0;
+    args.headless = false;
+    args.stats = false;
+    args.compact = false;
+    args.lodSpacing = 4.0f;
+    args.culling = true;
+    args.edgeBudget = 1000000;
+    args.lineWidth = 1.0f;
+    args.density = DENSITY_NONE;
+    args.maxSteps = 10000;
+    args.outfile = NULL;
+    args.csrfile = NULL;
+    args.edgeList = false;
+    args.memory = 1024;
 
     argp_parse(&argp, argc, argv, 0, 0, (void*) &args);
+    if (args.threads > 0) setThreadCount(args.threads);
+
+    if (args.runs > 1 && (args.components || args.pruneLeaves || args.pruneChains
+                          || (args.layout != LAYOUT_DEFAULT && args.layout != LAYOUT_FORCEATLAS2))) {
+        printf("Error: --runs only applies to the default and fa2 layouts, without --components or pruning\n");
+        return EXIT_FAILURE;
+    }
+
+    if (args.csrfile != NULL) {
+        if (args.edgefile == NULL){
+            printf("Error: -e option is required\n");
+            return EXIT_FAILURE;
+        }
+        CSRBuilder builder;
+        builder.memoryLimit = args.memory << 20;
+        const auto start = std::chrono::steady_clock::now();
+        const int status = args.edgeList ? builder.fromEdgeList(args.edgefile, args.csrfile)
+                                         : builder.fromAdjacency(args.edgefile, args.csrfile);
+        if (status != 0) return EXIT_FAILURE;
+        printf("Converted in %.3f s\n", secondsSince(start));
+        return EXIT_SUCCESS;
+    }
+
+    if (args.headless) {
+        if (args.edgefile == NULL){
+            printf("Error: -e option is required\n");
+            return EXIT_FAILURE;
+        }
+        return runHeadless(&args);
+    }
 
     if (args.edgefile == NULL || args.partfile == NULL){
         printf("Error: -e and -p options are required\n");
@@ -172,7 +458,15 @@ int main(int argc, char** argv){
 
     printf("%s, %s\n", args.edgefile, args.partfile);
 
+    app.compactAttributes = args.compact;
+    app.density = args.density;
     app.init(args.edgefile, args.partfile);
+    app.instrumentation = args.stats;
+    app.lodSpacing = args.lodSpacing;
+    app.culling = args.culling;
+    app.edgeBudget = args.edgeBudget;
+    app.lineWidth = args.lineWidth;
+    setupGraph(app.g, &args);
 
     glfwSetFramebufferSizeCallback(app.window, framebufferSizeCallback);
     glfwSetMouseButtonCallback(app.window, mouseCallback);
@@ -180,13 +474,14 @@ int main(int argc, char** argv){
     glfwSetScrollCallback(app.window, scrollCallback);
     glfwSetKeyCallback(app.window, keyCallback);
 
-    glEnable(GL_LINE_SMOOTH);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glEnable( GL_BLEND );
 
     // FPS seems to be set at 60 for my laptop
     while(!glfwWindowShouldClose(app.window)) {
-        glfwPollEvents();    
+        // Idle, the frames only copy the cached scene : they are only drawn on events
+        if (app.idle()) glfwWaitEventsTimeout(1.0);
+        else glfwPollEvents();
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
         app.draw();
@@ -0,0 +1,72 @@
+#include "headers/graph.hpp"
+#include "headers/thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+double Graph::edgeLengthVariation() const {
+    // Partial sums of fixed blocks are added in order whatever the number of threads
+    const size_t blockSize = 4096;
+    const size_t n_blocks = (n_vtx + blockSize - 1) / blockSize;
+    std::vector<double> blockSum(n_blocks), blockSum2(n_blocks);
+    std::vector<size_t> blockCount(n_blocks);
+    threadPool().blocks(n_vtx, blockSize, [&](size_t b, size_t begin, size_t end){
+        double sum = 0.0, sum2 = 0.0;
+        size_t count = 0;
+        for (size_t i = begin; i < end; i++){
+            for (size_t j = rowstart[i]; j < rowstart[i+1]; j++){
+                const size_t neig = adj[j];
+                if (neig == i) continue;
+                const double length = std::hypot(pos[2*i] - pos[2*neig], pos[2*i+1] - pos[2*neig+1]);
+                sum += length;
+                sum2 += length * length;
+                count++;
+            }
+        }
+        blockSum[b] = sum;
+        blockSum2[b] = sum2;
+        blockCount[b] = count;
+    });
+
+    double sum = 0.0, sum2 = 0.0;
+    size_t count = 0;
+    for (size_t b = 0; b < n_blocks; b++){
+        sum += blockSum[b];
+        sum2 += blockSum2[b];
+        count += blockCount[b];
+    }
+    if (count == 0 || sum <= 0.0) return 0.0;
+    const double mean = sum / count;
+    return std::sqrt(std::max(0.0, sum2 / count - mean * mean)) / mean;
+}
+
+// Each run is a task of the thread pool, the steps of a run are then computed serially
+void Graph::multiStart(size_t runs, initType init, unsigned int seed, size_t maxSteps){
+    if (runs == 0) return;
+
+    std::vector<std::unique_ptr<Graph>> replicas(runs);
+    std::vector<double> quality(runs);
+    threadPool().run(runs, [&](size_t r){
+        replicas[r].reset(new Graph(*this, init, seed + (unsigned int) r));
+        Graph& g = *replicas[r];
+        while (g.n_steps < maxSteps && !g.convergence.converged) g.step();
+        quality[r] = g.edgeLengthVariation();
+    });
+
+    size_t best = 0;
+    for (size_t r = 0; r < runs; r++){
+        if (verbose) {
+            printf("Run %zu (seed %u) : %s after %zu steps, edge length variation %.4f\n", r, seed + (unsigned int) r,
+                   replicas[r]->convergence.converged ? "converged" : "not converged", replicas[r]->n_steps, quality[r]);
+        }
+        if (quality[r] < quality[best]) best = r;
+    }
+    if (verbose) printf("Keeping run %zu\n", best);
+
+    pos = replicas[best]->pos;
+    n_steps = replicas[best]->n_steps;
+    convergence = replicas[best]->convergence;
+}
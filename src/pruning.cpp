@@ -0,0 +1,184 @@
+#include "headers/graph.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdio.h>
+#include <vector>
+
+// Number of neighbours other than the vertex itself
+static size_t degree(const Graph& g, size_t i){
+    size_t deg = 0;
+    for (size_t j = g.rowstart[i]; j < g.rowstart[i+1]; j++) deg += g.adj[j] != i;
+    return deg;
+}
+
+// The other neighbour of a degree 2 vertex
+static size_t otherNeighbour(const Graph& g, size_t i, size_t prev){
+    for (size_t j = g.rowstart[i]; j < g.rowstart[i+1]; j++){
+        if (g.adj[j] != i && g.adj[j] != prev) return g.adj[j];
+    }
+    return prev;
+}
+
+void Graph::prune(bool pruneLeaves, bool pruneChains){
+    std::vector<size_t> deg(n_vtx);
+    for (size_t i = 0; i < n_vtx; i++) deg[i] = degree(*this, i);
+    pruned.assign(n_vtx, 0);
+
+    // Leaves, an isolated edge is kept in the core
+    std::vector<size_t> parent(n_vtx, n_vtx);
+    if (pruneLeaves) {
+        for (size_t i = 0; i < n_vtx; i++){
+            if (deg[i] != 1) continue;
+            const size_t p = otherNeighbour(*this, i, i);
+            if (deg[p] > 1) { parent[i] = p; pruned[i] = 1; }
+        }
+    }
+
+    leafParents.clear(); leafStart.clear(); leaves.clear();
+    for (size_t p = 0; p < n_vtx; p++){
+        const size_t start = leaves.size();
+        for (size_t j = rowstart[p]; j < rowstart[p+1]; j++){
+            if (parent[adj[j]] == p) leaves.push_back(adj[j]);
+        }
+        if (leaves.size() > start) {
+            leafParents.push_back(p);
+            leafStart.push_back(start);
+        }
+    }
+    leafStart.push_back(leaves.size());
+
+    // Chains of degree 2 vertices between two vertices of the core, replaced by a single edge
+    chainEnds.clear(); chainStart.clear(); chains.clear();
+    std::vector<Edge> shortcuts;
+    if (pruneChains) {
+        auto inChain = [&](size_t i){
+            if (deg[i] != 2 || pruned[i]) return false;
+            for (size_t j = rowstart[i]; j < rowstart[i+1]; j++) if (pruned[adj[j]]) return false;
+            return true;
+        };
+        std::vector<unsigned char> visited(n_vtx, 0);
+        std::vector<size_t> left, right;
+        for (size_t i = 0; i < n_vtx; i++){
+            if (visited[i] || !inChain(i)) continue;
+
+            // Walk both ways until the first vertices out of the chain
+            size_t ends[2];
+            std::vector<size_t>* sides[2] = {&left, &right};
+            bool cycle = false;
+            for (int s = 0; s < 2 && !cycle; s++){
+                sides[s]->clear();
+                size_t prev = i;
+                size_t curr = s == 0 ? otherNeighbour(*this, i, n_vtx) : otherNeighbour(*this, i, otherNeighbour(*this, i, n_vtx));
+                while (inChain(curr) && curr != i) {
+                    sides[s]->push_back(curr);
+                    const size_t next = otherNeighbour(*this, curr, prev);
+                    prev = curr;
+                    curr = next;
+                }
+                cycle = curr == i;
+                ends[s] = curr;
+            }
+            visited[i] = 1;
+            for (const size_t v : left) visited[v] = 1;
+            for (const size_t v : right) visited[v] = 1;
+            if (cycle) continue; // A cycle of degree 2 vertices has no core to hang on
+
+            chainStart.push_back(chains.size());
+            chainEnds.push_back(ends[0]);
+            chainEnds.push_back(ends[1]);
+            for (size_t k = left.size(); k-- > 0;) chains.push_back(left[k]);
+            chains.push_back(i);
+            for (const size_t v : right) chains.push_back(v);
+
+            // The shortcut is weaker for longer chains
+            double w = adjw[rowstart[i]];
+            for (size_t k = chainStart.back(); k < chains.size(); k++){
+                const size_t v = chains[k];
+                pruned[v] = 1;
+                for (size_t j = rowstart[v]; j < rowstart[v+1]; j++) w = std::min(w, adjw[j]);
+            }
+            if (ends[0] != ends[1]) shortcuts.push_back({ends[0], ends[1], w / (chains.size() - chainStart.back() + 1)});
+        }
+    }
+    chainStart.push_back(chains.size());
+
+    coreVertices.clear();
+    std::vector<size_t> localIndex(n_vtx, 0);
+    for (size_t i = 0; i < n_vtx; i++){
+        if (pruned[i]) continue;
+        localIndex[i] = coreVertices.size();
+        coreVertices.push_back(i);
+    }
+    if (coreVertices.size() == n_vtx) return;
+
+    core.reset(new Graph(*this, coreVertices, localIndex));
+    core->verbose = false;
+    for (Edge& e : shortcuts) { e.src = localIndex[e.src]; e.dest = localIndex[e.dest]; }
+    core->addEdges(shortcuts);
+
+    printf("Pruned %zu leaves and %zu chain vertices, the core has %zu vertices\n",
+           leaves.size(), chains.size(), coreVertices.size());
+    reattach();
+    wake();
+}
+
+void Graph::reattach(){
+    for (size_t i = 0; i < coreVertices.size(); i++){
+        pos[2*coreVertices[i]] = core->pos[2*i];
+        pos[2*coreVertices[i]+1] = core->pos[2*i+1];
+    }
+
+    // Chains are evenly spread on the segment between their ends,
+    // or on a loop when both ends are the same vertex
+    for (size_t c = 0; c + 1 < chainStart.size(); c++){
+        const size_t a = chainEnds[2*c], b = chainEnds[2*c+1];
+        const size_t len = chainStart[c+1] - chainStart[c];
+        const float ax = pos[2*a], ay = pos[2*a+1];
+        const float bx = pos[2*b], by = pos[2*b+1];
+        for (size_t k = 0; k < len; k++){
+            const size_t v = chains[chainStart[c] + k];
+            const float t = (float) (k+1) / (len+1);
+            if (a != b) {
+                pos[2*v]   = ax + t * (bx - ax);
+                pos[2*v+1] = ay + t * (by - ay);
+            } else {
+                const float angle = 2.0f * M_PI * t;
+                pos[2*v]   = ax + 0.5f * len * (1.0f - std::cos(angle));
+                pos[2*v+1] = ay + 0.5f * len * std::sin(angle);
+            }
+        }
+    }
+
+    // Leaves are put on a fan around their parent, facing away from its other neighbours,
+    // at half the mean distance to them
+    for (size_t l = 0; l < leafParents.size(); l++){
+        const size_t p = leafParents[l];
+        const float px = pos[2*p], py = pos[2*p+1];
+        float cx = 0.0f, cy = 0.0f, dist = 0.0f;
+        size_t n_neig = 0;
+        for (size_t j = rowstart[p]; j < rowstart[p+1]; j++){
+            const size_t neig = adj[j];
+            if (neig == p || (pruned[neig] && degree(*this, neig) == 1)) continue;
+            cx += pos[2*neig]; cy += pos[2*neig+1];
+            dist += std::hypot(pos[2*neig] - px, pos[2*neig+1] - py);
+            n_neig++;
+        }
+
+        const size_t k = leafStart[l+1] - leafStart[l];
+        float radius = 0.5f, direction = 0.0f, span = 2.0f * M_PI;
+        if (n_neig > 0) {
+            radius = 0.5f * dist / n_neig;
+            direction = std::atan2(py - cy / n_neig, px - cx / n_neig);
+            span = 2.0f * M_PI * k / (k + n_neig);
+        }
+        if (radius <= 0.0f) radius = 0.5f;
+
+        for (size_t i = 0; i < k; i++){
+            const size_t v = leaves[leafStart[l] + i];
+            const float angle = direction + span * ((i + 0.5f) / k - 0.5f);
+            pos[2*v]   = px + radius * std::cos(angle);
+            pos[2*v+1] = py + radius * std::sin(angle);
+        }
+    }
+}
@@ -0,0 +1,247 @@
+#include "headers/quadtree.hpp"
+#include "headers/thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Cells are half open so that every point belongs to exactly one child
+bool QuadTree::inside(const Node& node, float x, float y) const {
+    return x >= node.cx - node.half && x < node.cx + node.half
+        && y >= node.cy - node.half && y < node.cy + node.half;
+}
+
+void QuadTree::split(unsigned int node, const float* pos){
+    const unsigned int first = (unsigned int) nodes.size();
+    nodes.resize(nodes.size() + 4);
+
+    Node& parent = nodes[node];
+    const float h = 0.5f * parent.half;
+    for (unsigned int c = 0; c < 4; c++){
+        Node& child = nodes[first + c];
+        child.cx = parent.cx + ((c & 1) ? h : -h);
+        child.cy = parent.cy + ((c & 2) ? h : -h);
+        child.half = h;
+        child.child = 0;
+        child.depth = parent.depth + 1;
+    }
+    parent.child = first;
+
+    std::vector<unsigned int> vertices;
+    vertices.swap(parent.vertices);
+    for (const unsigned int v : vertices){
+        const unsigned int c = (pos[2*v] >= parent.cx ? 1 : 0) + (pos[2*v+1] >= parent.cy ? 2 : 0);
+        Node& child = nodes[first + c];
+        leafOf[v] = first + c;
+        slot[v] = (unsigned int) child.vertices.size();
+        child.vertices.push_back(v);
+    }
+}
+
+void QuadTree::insert(unsigned int v, const float* pos){
+    const float x = pos[2*v];
+    const float y = pos[2*v+1];
+
+    unsigned int node = 0;
+    while (nodes[node].child != 0) {
+        const Node& n = nodes[node];
+        node = n.child + (x >= n.cx ? 1 : 0) + (y >= n.cy ? 2 : 0);
+    }
+
+    leafOf[v] = node;
+    slot[v] = (unsigned int) nodes[node].vertices.size();
+    nodes[node].vertices.push_back(v);
+    if (nodes[node].vertices.size() > leafSize && nodes[node].depth < std::min(maxDepth, 32u)) split(node, pos);
+}
+
+// Masses, centers of mass and bounding boxes, children before their parent
+void QuadTree::refit(const float* pos, const float* mass){
+    for (size_t k = nodes.size(); k-- > 0;){
+        Node& node = nodes[k];
+        node.mass = 0.0f;
+        node.mx = node.my = 0.0f;
+        node.minx = node.miny = INFINITY;
+        node.maxx = node.maxy = -INFINITY;
+
+        if (node.child == 0) {
+            for (const unsigned int v : node.vertices){
+                const float m = mass ? mass[v] : 1.0f;
+                const float x = pos[2*v];
+                const float y = pos[2*v+1];
+                node.mass += m;
+                node.mx += m * x;
+                node.my += m * y;
+                node.minx = std::min(node.minx, x); node.maxx = std::max(node.maxx, x);
+                node.miny = std::min(node.miny, y); node.maxy = std::max(node.maxy, y);
+            }
+        } else {
+            for (unsigned int c = 0; c < 4; c++){
+                const Node& child = nodes[node.child + c];
+                if (child.mass <= 0.0f) continue;
+                node.mass += child.mass;
+                node.mx += child.mass * child.mx;
+                node.my += child.mass * child.my;
+                node.minx = std::min(node.minx, child.minx); node.maxx = std::max(node.maxx, child.maxx);
+                node.miny = std::min(node.miny, child.miny); node.maxy = std::max(node.maxy, child.maxy);
+            }
+        }
+        if (node.mass > 0.0f) {
+            node.mx /= node.mass;
+            node.my /= node.mass;
+        }
+    }
+}
+
+void QuadTree::build(const float* pos, const float* mass, size_t n){
+    nodes.clear();
+    leafOf.resize(n);
+    slot.resize(n);
+
+    float minx = INFINITY, maxx = -INFINITY, miny = INFINITY, maxy = -INFINITY;
+    for (size_t i = 0; i < n; i++){
+        minx = std::min(minx, pos[2*i]); maxx = std::max(maxx, pos[2*i]);
+        miny = std::min(miny, pos[2*i+1]); maxy = std::max(maxy, pos[2*i+1]);
+    }
+    if (n == 0) minx = maxx = miny = maxy = 0.0f;
+
+    // Some margin so that vertices moving outward stay in the root for a while
+    Node root = Node();
+    root.cx = 0.5f * (minx + maxx);
+    root.cy = 0.5f * (miny + maxy);
+    root.half = std::max(0.6f * std::max(maxx - minx, maxy - miny), 1e-6f);
+    root.child = 0;
+    root.depth = 0;
+    nodes.push_back(root);
+
+    for (size_t i = 0; i < n; i++) insert((unsigned int) i, pos);
+    builtNodes = nodes.size();
+    n_builds++;
+    refit(pos, mass);
+}
+
+void QuadTree::update(const float* pos, const float* mass, size_t n){
+    if (nodes.empty() || leafOf.size() != n) return build(pos, mass, n);
+
+    // Take the vertices that left their cell out of their leaf
+    std::vector<unsigned int> moved;
+    const size_t maxMoved = (size_t) (rebuildFraction * n);
+    float minx = INFINITY, maxx = -INFINITY, miny = INFINITY, maxy = -INFINITY;
+    for (size_t i = 0; i < n; i++){
+        const float x = pos[2*i];
+        const float y = pos[2*i+1];
+        minx = std::min(minx, x); maxx = std::max(maxx, x);
+        miny = std::min(miny, y); maxy = std::max(maxy, y);
+        if (inside(nodes[leafOf[i]], x, y)) continue;
+        if (moved.size() >= maxMoved || !inside(nodes[0], x, y)) return build(pos, mass, n);
+        moved.push_back((unsigned int) i);
+    }
+
+    // A layout that shrank leaves most of the tree empty
+    if (std::max(maxx - minx, maxy - miny) < 2.0f * shrinkFactor * nodes[0].half) return build(pos, mass, n);
+
+    for (const unsigned int v : moved){
+        std::vector<unsigned int>& vertices = nodes[leafOf[v]].vertices;
+        const unsigned int last = vertices.back();
+        vertices[slot[v]] = last;
+        slot[last] = slot[v];
+        vertices.pop_back();
+    }
+    for (const unsigned int v : moved) insert(v, pos);
+
+    // Empty leaves are never merged back
+    if (nodes.size() > growthFactor * builtNodes) return build(pos, mass, n);
+    refit(pos, mass);
+}
+
+// Interactions are evaluated n_lanes at a time with the vector extensions of GCC,
+// which fall back to narrower instructions when the target has no 256 bits registers
+static const size_t n_lanes = 8;
+typedef float floatv __attribute__((vector_size(n_lanes * sizeof(float))));
+
+// Sources acting on a leaf, padded with zero masses up to a multiple of n_lanes
+struct InteractionList {
+    std::vector<floatv> x, y, m;
+    size_t size = 0;
+
+    void clear(){ x.clear(); y.clear(); m.clear(); size = 0; }
+    void push(float px, float py, float pm){
+        if (size % n_lanes == 0) {
+            x.push_back(floatv{});
+            y.push_back(floatv{});
+            m.push_back(floatv{});
+        }
+        const size_t lane = size % n_lanes;
+        x.back()[lane] = px;
+        y.back()[lane] = py;
+        m.back()[lane] = pm;
+        size++;
+    }
+};
+
+void QuadTree::repulsion(const float* pos, const float* mass, const unsigned char* asleep, float theta, float* force) const {
+    std::vector<unsigned int> leaves;
+    for (size_t k = 0; k < nodes.size(); k++){
+        if (nodes[k].child != 0 || nodes[k].vertices.empty()) continue;
+        bool awake = asleep == nullptr;
+        for (const unsigned int v : nodes[k].vertices) awake = awake || !asleep[v];
+        if (awake) leaves.push_back((unsigned int) k);
+    }
+
+    const float theta2 = theta * theta;
+    threadPool().parallel_for(leaves.size(), [&](size_t begin, size_t end){
+        InteractionList list;
+        unsigned int stack[4 * 32];
+        for (size_t l = begin; l < end; l++){
+            const Node& leaf = nodes[leaves[l]];
+
+            // Conservative opening criterion : the distance from the center of mass of a node
+            // to the closest point of the leaf stands for the distance to every vertex of the leaf
+            list.clear();
+            size_t top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const Node& node = nodes[stack[--top]];
+                if (node.mass <= 0.0f) continue;
+
+                if (node.child == 0) {
+                    for (const unsigned int v : node.vertices) list.push(pos[2*v], pos[2*v+1], mass ? mass[v] : 1.0f);
+                    continue;
+                }
+
+                const bool disjoint = node.maxx < leaf.minx || node.minx > leaf.maxx
+                                   || node.maxy < leaf.miny || node.miny > leaf.maxy;
+                const float size = std::max(node.maxx - node.minx, node.maxy - node.miny);
+                const float dx = std::max(0.0f, std::max(leaf.minx - node.mx, node.mx - leaf.maxx));
+                const float dy = std::max(0.0f, std::max(leaf.miny - node.my, node.my - leaf.maxy));
+                if (disjoint && size*size < theta2 * (dx*dx + dy*dy)) {
+                    list.push(node.mx, node.my, node.mass);
+                    continue;
+                }
+                for (unsigned int c = 0; c < 4; c++) stack[top++] = node.child + c;
+            }
+
+            // Every vertex of the leaf against the whole list. The padding has no mass and the vertex
+            // itself is at distance 0 : the tiny softening keeps their contribution to exactly 0
+            const floatv softening = floatv{} + 1e-20f;
+            for (const unsigned int v : leaf.vertices){
+                const floatv px = floatv{} + pos[2*v];
+                const floatv py = floatv{} + pos[2*v+1];
+                floatv fx = {}, fy = {};
+                for (size_t c = 0; c < list.x.size(); c++){
+                    const floatv vx = px - list.x[c];
+                    const floatv vy = py - list.y[c];
+                    const floatv f = list.m[c] / (vx*vx + vy*vy + softening);
+                    fx += f * vx;
+                    fy += f * vy;
+                }
+                float sx = 0.0f, sy = 0.0f;
+                for (size_t lane = 0; lane < n_lanes; lane++){
+                    sx += fx[lane];
+                    sy += fy[lane];
+                }
+                force[2*v] = sx;
+                force[2*v+1] = sy;
+            }
+        }
+    });
+}
@@ -43,10 +43,8 @@ GLuint loadShaders(const char* fpath, GLuint shader_type){
     return shaderId;
 }
 
-GLuint loadProgram(GLuint vtxShaderId, GLuint fragShaderId){
-    GLuint programId = glCreateProgram();
-    glAttachShader(programId, vtxShaderId);
-    glAttachShader(programId, fragShaderId);
+// Link the shaders attached to programId, printing the log
+static GLuint linkProgram(GLuint programId){
     glLinkProgram(programId);
 
     GLint res;
@@ -62,3 +60,16 @@ GLuint loadProgram(GLuint vtxShaderId, GLuint fragShaderId){
 	
     return programId;
 }
+
+GLuint loadProgram(GLuint vtxShaderId, GLuint fragShaderId){
+    GLuint programId = glCreateProgram();
+    glAttachShader(programId, vtxShaderId);
+    glAttachShader(programId, fragShaderId);
+    return linkProgram(programId);
+}
+
+GLuint loadComputeProgram(GLuint computeShaderId){
+    GLuint programId = glCreateProgram();
+    glAttachShader(programId, computeShaderId);
+    return linkProgram(programId);
+}
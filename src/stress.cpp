@@ -0,0 +1,154 @@
+#include "headers/stress.hpp"
+#include "headers/graph.hpp"
+#include "headers/thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <utility>
+#include <vector>
+
+size_t StressSGD::bucketIndex(unsigned int a, unsigned int b) const {
+    if (a > b) std::swap(a, b);
+    return a * n_blocks + b;
+}
+
+void StressSGD::addTerm(const Term& t){
+    buckets[bucketIndex(t.i % n_blocks, t.j % n_blocks)].push_back(t);
+}
+
+// Every pair of vertices connected by a path
+void StressSGD::initExact(const Graph& g){
+    std::vector<int> dist;
+    for (size_t i = 0; i < n_vtx; i++){
+        g.bfs(i, dist);
+        for (size_t j = i+1; j < n_vtx; j++){
+            if (dist[j] <= 0) continue;
+            const float d = (float) dist[j];
+            const float w = 1.0f / (d*d);
+            addTerm({(unsigned int) i, (unsigned int) j, d, w, w});
+        }
+    }
+}
+
+// Edges + distances to the pivots (Ortmann et al., "Sparse stress models")
+void StressSGD::initSparse(const Graph& g){
+    const size_t k = std::min(pivots, n_vtx);
+
+    std::vector<std::vector<int>> pivotDist;
+    std::vector<size_t> pivot;
+    g.pivotDistances(k, seed, pivot, pivotDist);
+
+    // Each vertex belongs to the region of its closest pivot
+    std::vector<size_t> region(n_vtx, k);
+    for (size_t i = 0; i < n_vtx; i++){
+        for (size_t p = 0; p < k; p++){
+            const int d = pivotDist[p][i];
+            if (d >= 0 && (region[i] == k || d < pivotDist[region[i]][i])) region[i] = p;
+        }
+    }
+
+    // regionCount[p][h] : number of vertices of the region of p at distance <= h of p
+    std::vector<std::vector<size_t>> regionCount(k);
+    for (size_t i = 0; i < n_vtx; i++){
+        if (region[i] == k) continue;
+        const size_t p = region[i];
+        const size_t d = pivotDist[p][i];
+        if (regionCount[p].size() <= d) regionCount[p].resize(d+1, 0);
+        regionCount[p][d]++;
+    }
+    for (size_t p = 0; p < k; p++){
+        for (size_t h = 1; h < regionCount[p].size(); h++) regionCount[p][h] += regionCount[p][h-1];
+    }
+
+    // Edges
+    for (size_t i = 0; i < n_vtx; i++){
+        for (size_t j = g.rowstart[i]; j < g.rowstart[i+1]; j++){
+            if (g.adj[j] > i) addTerm({(unsigned int) i, (unsigned int) g.adj[j], 1.0f, 1.0f, 1.0f});
+        }
+    }
+
+    // A pivot stands for the vertices of its region that are closer to it than to i.
+    // Only i is moved by these terms.
+    for (size_t p = 0; p < k; p++){
+        for (size_t i = 0; i < n_vtx; i++){
+            const int d = pivotDist[p][i];
+            if (d <= 1) continue; // Itself, unreachable or already an edge
+            const size_t h = std::min((size_t) d / 2, regionCount[p].size() - 1);
+            const float s = (float) std::max((size_t) 1, regionCount[p][h]);
+            addTerm({(unsigned int) i, (unsigned int) pivot[p], (float) d, s / (float) (d*d), 0.0f});
+        }
+    }
+}
+
+void StressSGD::init(const Graph& g){
+    n_vtx = g.n_vtx;
+    epoch = 0;
+    buckets.assign(n_blocks * n_blocks, std::vector<Term>());
+
+    if (n_vtx <= maxExactVertices) initExact(g);
+    else initSparse(g);
+
+    // Annealing schedule of the step size
+    float wMin = INFINITY, wMax = 0.0f;
+    for (const std::vector<Term>& b : buckets){
+        for (const Term& t : b){
+            for (const float w : {t.wi, t.wj}){
+                if (w <= 0.0f) continue;
+                wMin = std::min(wMin, w);
+                wMax = std::max(wMax, w);
+            }
+        }
+    }
+    if (wMax > 0.0f) {
+        etaMax = 1.0f / wMin;
+        etaMin = epsilon / wMax;
+        lambda = epochs > 1 ? std::log(etaMax / etaMin) / (epochs - 1) : 0.0f;
+    }
+
+    // Every round is a set of buckets sharing no block
+    rounds.clear();
+    for (const std::vector<std::pair<unsigned int, unsigned int>>& blocks : blockRounds(n_blocks)){
+        rounds.push_back(std::vector<size_t>());
+        for (const std::pair<unsigned int, unsigned int>& b : blocks) rounds.back().push_back(bucketIndex(b.first, b.second));
+    }
+}
+
+void StressSGD::step(const Graph& g, float* pos){
+    if (n_vtx != g.n_vtx) init(g);
+
+    const float eta = epoch < epochs ? etaMax * std::exp(-lambda * epoch) : etaMin;
+
+    // The schedule is shuffled at every epoch, from seed only
+    std::mt19937 rng(seed + epoch);
+    std::vector<size_t> order(rounds.size());
+    for (size_t r = 0; r < order.size(); r++) order[r] = r;
+    std::shuffle(order.begin(), order.end(), rng);
+
+    for (const size_t r : order){
+        const std::vector<size_t>& round = rounds[r];
+        threadPool().run(round.size(), [&](size_t b){
+            std::vector<Term>& terms = buckets[round[b]];
+            std::mt19937 bucketRng(seed + epoch * n_blocks * n_blocks + round[b]);
+            std::shuffle(terms.begin(), terms.end(), bucketRng);
+
+            for (const Term& t : terms){
+                float* pi = &pos[2*t.i];
+                float* pj = &pos[2*t.j];
+                const float dx = pi[0] - pj[0];
+                const float dy = pi[1] - pj[1];
+                const float mag = std::hypot(dx, dy);
+                if (mag <= 1e-9f) continue;
+
+                // Move both vertices toward distance d
+                const float ratio = (mag - t.d) / (2.0f * mag);
+                const float mui = g.asleep[t.i] ? 0.0f : std::min(t.wi * eta, 1.0f);
+                const float muj = g.asleep[t.j] ? 0.0f : std::min(t.wj * eta, 1.0f);
+                pi[0] -= mui * ratio * dx; pi[1] -= mui * ratio * dy;
+                pj[0] += muj * ratio * dx; pj[1] += muj * ratio * dy;
+            }
+        });
+    }
+
+    epoch++;
+}
@@ -0,0 +1,123 @@
+#include "headers/thread_pool.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Set in the worker threads and while the calling thread executes a batch
+static thread_local bool insideTask = false;
+
+ThreadPool::ThreadPool(size_t n_threads){
+    for (size_t i = 1; i < n_threads; i++) workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeWorkers.notify_all();
+    for (std::thread& t : workers) t.join();
+}
+
+// Take tasks of the current batch until there are none left
+void ThreadPool::work(const std::function<void(size_t)>& f, size_t n){
+    size_t i;
+    while ((i = nextTask.fetch_add(1)) < n) f(i);
+}
+
+void ThreadPool::workerLoop(){
+    insideTask = true;
+    size_t seen = 0;
+    while (true) {
+        const std::function<void(size_t)>* f;
+        size_t n;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeWorkers.wait(lock, [&]{ return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            f = task;
+            n = n_tasks;
+        }
+
+        work(*f, n);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++finishedWorkers == workers.size()) batchDone.notify_all();
+    }
+}
+
+void ThreadPool::run(size_t n, const std::function<void(size_t)>& f){
+    if (n == 0) return;
+
+    // Nested batch or nothing to share : run serially
+    if (insideTask || workers.empty() || n == 1) {
+        for (size_t i = 0; i < n; i++) f(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> batchLock(batchMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &f;
+        n_tasks = n;
+        nextTask = 0;
+        finishedWorkers = 0;
+        generation++;
+    }
+    wakeWorkers.notify_all();
+
+    insideTask = true;
+    work(f, n);
+    insideTask = false;
+
+    // The batch is over once every worker is done with it
+    std::unique_lock<std::mutex> lock(mutex);
+    batchDone.wait(lock, [&]{ return finishedWorkers == workers.size(); });
+    task = nullptr;
+}
+
+void ThreadPool::parallel_for(size_t n, const std::function<void(size_t, size_t)>& body){
+    if (n == 0) return;
+
+    // A few chunks per thread to balance the load
+    const size_t n_chunks = std::min(n, 4 * size());
+    const size_t chunk = (n + n_chunks - 1) / n_chunks;
+    run((n + chunk - 1) / chunk, [&](size_t c){
+        body(c * chunk, std::min(n, (c+1) * chunk));
+    });
+}
+
+void ThreadPool::blocks(size_t n, size_t blockSize, const std::function<void(size_t, size_t, size_t)>& body){
+    run((n + blockSize - 1) / blockSize, [&](size_t b){
+        body(b, b * blockSize, std::min(n, (b+1) * blockSize));
+    });
+}
+
+static std::unique_ptr<ThreadPool> pool;
+
+ThreadPool& threadPool(){
+    if (!pool) pool.reset(new ThreadPool(std::max(1u, std::thread::hardware_concurrency())));
+    return *pool;
+}
+
+void setThreadCount(size_t n_threads){
+    pool.reset(new ThreadPool(std::max((size_t) 1, n_threads)));
+}
+
+std::vector<std::vector<std::pair<unsigned int, unsigned int>>> blockRounds(unsigned int n_blocks){
+    std::vector<std::vector<std::pair<unsigned int, unsigned int>>> rounds(n_blocks);
+    for (unsigned int a = 0; a < n_blocks; a++) rounds[0].push_back({a, a});
+    for (unsigned int r = 0; r + 1 < n_blocks; r++){
+        rounds[r+1].push_back({n_blocks - 1, r});
+        for (unsigned int a = 1; a < n_blocks / 2; a++){
+            rounds[r+1].push_back({(r + a) % (n_blocks - 1), (r + n_blocks - 1 - a) % (n_blocks - 1)});
+        }
+    }
+    return rounds;
+}